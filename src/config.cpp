@@ -86,7 +86,28 @@ struct {
   tsf::ParameterBool*    log;
   tsf::ParameterBool*    full_mipmaps;
   tsf::ParameterInt*     max_cache_size;
+  tsf::ParameterInt*     min_cache_size;
+  tsf::ParameterBool*    adaptive_cache;
+  tsf::ParameterInt*     min_free_vram;
+  tsf::ParameterInt*     min_free_va;
   tsf::ParameterInt*     max_decomp_jobs;
+  tsf::ParameterInt*     io_threads;
+  tsf::ParameterInt*     completion_budget;
+  tsf::ParameterInt*     upload_budget_size;
+  tsf::ParameterInt*     upload_budget_time;
+  tsf::ParameterBool*    load_screens;
+  tsf::ParameterInt*     reset_shadow_size;
+  tsf::ParameterInt*     ram_cache_size;
+  tsf::ParameterBool*    idle_prefetch;
+  tsf::ParameterBool*    scene_prefetch;
+  tsf::ParameterInt*     disk_cache_size;
+  tsf::ParameterInt*     max_mip_drop;
+  tsf::ParameterInt*     preview_size;
+  tsf::ParameterStringW* partition_ui;
+  tsf::ParameterStringW* partition_font;
+  tsf::ParameterStringW* partition_blocking;
+  tsf::ParameterStringW* partition_world;
+  tsf::ParameterStringW* ui_textures;
 } textures;
 
 struct {
@@ -446,6 +467,46 @@ TSFix_LoadConfig (std::wstring name)
       L"TSFix.Textures",
         L"MaxCacheInMiB" );
 
+  textures.min_cache_size =
+    static_cast <tsf::ParameterInt *>
+      (g_ParameterFactory.create_parameter <int> (
+        L"Minimum Size of Texture Cache (Adaptive Floor)")
+      );
+  textures.min_cache_size->register_to_ini (
+    dll_ini,
+      L"TSFix.Textures",
+        L"MinCacheInMiB" );
+
+  textures.adaptive_cache =
+    static_cast <tsf::ParameterBool *>
+      (g_ParameterFactory.create_parameter <bool> (
+        L"Shrink / Grow the Texture Cache Based on Available Memory")
+      );
+  textures.adaptive_cache->register_to_ini (
+    dll_ini,
+      L"TSFix.Textures",
+        L"AdaptiveCache" );
+
+  textures.min_free_vram =
+    static_cast <tsf::ParameterInt *>
+      (g_ParameterFactory.create_parameter <int> (
+        L"Texture Memory to Keep Free (Adaptive Low Watermark)")
+      );
+  textures.min_free_vram->register_to_ini (
+    dll_ini,
+      L"TSFix.Textures",
+        L"MinFreeVRAMInMiB" );
+
+  textures.min_free_va =
+    static_cast <tsf::ParameterInt *>
+      (g_ParameterFactory.create_parameter <int> (
+        L"Contiguous Address Space to Keep Free (Adaptive Low Watermark)")
+      );
+  textures.min_free_va->register_to_ini (
+    dll_ini,
+      L"TSFix.Textures",
+        L"MinFreeAddressSpaceInMiB" );
+
   textures.max_decomp_jobs =
     static_cast <tsf::ParameterInt *>
       (g_ParameterFactory.create_parameter <int> (
@@ -456,6 +517,176 @@ TSFix_LoadConfig (std::wstring name)
       L"TSFix.Textures",
         L"MaxDecompressionJobs" );
 
+  textures.io_threads =
+    static_cast <tsf::ParameterInt *>
+      (g_ParameterFactory.create_parameter <int> (
+        L"Number of Threads Reading Textures From Disk")
+      );
+  textures.io_threads->register_to_ini (
+    dll_ini,
+      L"TSFix.Textures",
+        L"IOThreads" );
+
+  textures.completion_budget =
+    static_cast <tsf::ParameterInt *>
+      (g_ParameterFactory.create_parameter <int> (
+        L"Time to Spend Finishing Streamed Textures Each Frame (0 = Unlimited)")
+      );
+  textures.completion_budget->register_to_ini (
+    dll_ini,
+      L"TSFix.Textures",
+        L"CompletionBudgetInUsecs" );
+
+  textures.upload_budget_size =
+    static_cast <tsf::ParameterInt *>
+      (g_ParameterFactory.create_parameter <int> (
+        L"Texture Data to Upload at the End of Each Frame (0 = Upload from Workers)")
+      );
+  textures.upload_budget_size->register_to_ini (
+    dll_ini,
+      L"TSFix.Textures",
+        L"UploadBudgetInKiB" );
+
+  textures.upload_budget_time =
+    static_cast <tsf::ParameterInt *>
+      (g_ParameterFactory.create_parameter <int> (
+        L"Time to Spend Uploading Textures at the End of Each Frame")
+      );
+  textures.upload_budget_time->register_to_ini (
+    dll_ini,
+      L"TSFix.Textures",
+        L"UploadBudgetInUsecs" );
+
+  textures.load_screens =
+    static_cast <tsf::ParameterBool *>
+      (g_ParameterFactory.create_parameter <bool> (
+        L"Watch the Game's PAC Loads to Detect Loading Screens and Areas")
+      );
+  textures.load_screens->register_to_ini (
+    dll_ini,
+      L"TSFix.Textures",
+        L"DetectLoadScreens" );
+
+  textures.reset_shadow_size =
+    static_cast <tsf::ParameterInt *>
+      (g_ParameterFactory.create_parameter <int> (
+        L"System Memory Copies of Injected Textures, to Speed Up Device Reset (0 = Disable)")
+      );
+  textures.reset_shadow_size->register_to_ini (
+    dll_ini,
+      L"TSFix.Textures",
+        L"ResetShadowCacheInMiB" );
+
+  textures.ram_cache_size =
+    static_cast <tsf::ParameterInt *>
+      (g_ParameterFactory.create_parameter <int> (
+        L"Decompressed Texture Data Kept in RAM After Eviction (0 = Disable)")
+      );
+  textures.ram_cache_size->register_to_ini (
+    dll_ini,
+      L"TSFix.Textures",
+        L"RAMCacheInMiB" );
+
+  textures.idle_prefetch =
+    static_cast <tsf::ParameterBool *>
+      (g_ParameterFactory.create_parameter <bool> (
+        L"Refill the RAM Cache While the Game is in the Background or a Menu")
+      );
+  textures.idle_prefetch->register_to_ini (
+    dll_ini,
+      L"TSFix.Textures",
+        L"IdlePrefetch" );
+
+  textures.scene_prefetch =
+    static_cast <tsf::ParameterBool *>
+      (g_ParameterFactory.create_parameter <bool> (
+        L"Decode the Textures an Area Used Last Time as Soon as it Loads Again")
+      );
+  textures.scene_prefetch->register_to_ini (
+    dll_ini,
+      L"TSFix.Textures",
+        L"ScenePrefetch" );
+
+  textures.disk_cache_size =
+    static_cast <tsf::ParameterInt *>
+      (g_ParameterFactory.create_parameter <int> (
+        L"Decompressed Archive Textures Cached on Disk (0 = Disable)")
+      );
+  textures.disk_cache_size->register_to_ini (
+    dll_ini,
+      L"TSFix.Textures",
+        L"DiskCacheInMiB" );
+
+  textures.max_mip_drop =
+    static_cast <tsf::ParameterInt *>
+      (g_ParameterFactory.create_parameter <int> (
+        L"Mip Levels Dropped from Cold Overrides Before Eviction (0 = Disable)")
+      );
+  textures.max_mip_drop->register_to_ini (
+    dll_ini,
+      L"TSFix.Textures",
+        L"MaxMipDrop" );
+
+  textures.preview_size =
+    static_cast <tsf::ParameterInt *>
+      (g_ParameterFactory.create_parameter <int> (
+        L"Largest Mip Shown While a Large Override Loads (0 = Disable)")
+      );
+  textures.preview_size->register_to_ini (
+    dll_ini,
+      L"TSFix.Textures",
+        L"PreviewMipSize" );
+
+  textures.partition_ui =
+    static_cast <tsf::ParameterStringW *>
+      (g_ParameterFactory.create_parameter <std::wstring> (
+        L"UI Texture Partition Quota and Eviction Policy")
+      );
+  textures.partition_ui->register_to_ini (
+    dll_ini,
+      L"TSFix.Textures",
+        L"UIPartition" );
+
+  textures.partition_font =
+    static_cast <tsf::ParameterStringW *>
+      (g_ParameterFactory.create_parameter <std::wstring> (
+        L"Font Texture Partition Quota and Eviction Policy")
+      );
+  textures.partition_font->register_to_ini (
+    dll_ini,
+      L"TSFix.Textures",
+        L"FontPartition" );
+
+  textures.partition_blocking =
+    static_cast <tsf::ParameterStringW *>
+      (g_ParameterFactory.create_parameter <std::wstring> (
+        L"Blocking Texture Partition Quota and Eviction Policy")
+      );
+  textures.partition_blocking->register_to_ini (
+    dll_ini,
+      L"TSFix.Textures",
+        L"BlockingPartition" );
+
+  textures.partition_world =
+    static_cast <tsf::ParameterStringW *>
+      (g_ParameterFactory.create_parameter <std::wstring> (
+        L"World Texture Partition Quota and Eviction Policy")
+      );
+  textures.partition_world->register_to_ini (
+    dll_ini,
+      L"TSFix.Textures",
+        L"WorldPartition" );
+
+  textures.ui_textures =
+    static_cast <tsf::ParameterStringW *>
+      (g_ParameterFactory.create_parameter <std::wstring> (
+        L"Checksums of Textures in the UI Partition")
+      );
+  textures.ui_textures->register_to_ini (
+    dll_ini,
+      L"TSFix.Textures",
+        L"UITextures" );
+
   textures.log =
     static_cast <tsf::ParameterBool *>
       (g_ParameterFactory.create_parameter <bool> (
@@ -609,7 +840,28 @@ TSFix_LoadConfig (std::wstring name)
   textures.full_mipmaps->load    (config.textures.full_mipmaps);
   textures.log->load             (config.textures.log);
   textures.max_cache_size->load  (config.textures.max_cache_in_mib);
+  textures.min_cache_size->load  (config.textures.min_cache_in_mib);
+  textures.adaptive_cache->load  (config.textures.adaptive_cache);
+  textures.min_free_vram->load   (config.textures.min_free_vram);
+  textures.min_free_va->load     (config.textures.min_free_va);
   textures.max_decomp_jobs->load (config.textures.max_decomp_jobs);
+  textures.io_threads->load      (config.textures.io_threads);
+  textures.completion_budget->load (config.textures.completion_us);
+  textures.upload_budget_size->load (config.textures.upload_kib);
+  textures.upload_budget_time->load (config.textures.upload_us);
+  textures.load_screens->load      (config.textures.load_screens);
+  textures.reset_shadow_size->load (config.textures.shadow_in_mib);
+  textures.ram_cache_size->load    (config.textures.ram_cache_in_mib);
+  textures.idle_prefetch->load     (config.textures.idle_prefetch);
+  textures.scene_prefetch->load    (config.textures.scene_prefetch);
+  textures.disk_cache_size->load   (config.textures.disk_in_mib);
+  textures.max_mip_drop->load      (config.textures.max_mip_drop);
+  textures.preview_size->load      (config.textures.preview_size);
+  textures.partition_ui->load      (config.textures.partitions.ui);
+  textures.partition_font->load    (config.textures.partitions.font);
+  textures.partition_blocking->load (config.textures.partitions.blocking);
+  textures.partition_world->load   (config.textures.partitions.world);
+  textures.ui_textures->load       (config.textures.partitions.ui_crc32s);
 
   // When this option is set, it is essential to force 16x AF on
   if (config.textures.full_mipmaps) {
@@ -693,8 +945,29 @@ TSFix_SaveConfig (std::wstring name, bool close_config) {
 
   textures.cache->store               (config.textures.cache);
   textures.max_cache_size->store      (config.textures.max_cache_in_mib);
+  textures.min_cache_size->store      (config.textures.min_cache_in_mib);
+  textures.adaptive_cache->store      (config.textures.adaptive_cache);
+  textures.min_free_vram->store       (config.textures.min_free_vram);
+  textures.min_free_va->store         (config.textures.min_free_va);
 
   textures.max_decomp_jobs->store     (config.textures.max_decomp_jobs);
+  textures.io_threads->store          (config.textures.io_threads);
+  textures.completion_budget->store   (config.textures.completion_us);
+  textures.upload_budget_size->store  (config.textures.upload_kib);
+  textures.upload_budget_time->store  (config.textures.upload_us);
+  textures.load_screens->store        (config.textures.load_screens);
+  textures.reset_shadow_size->store   (config.textures.shadow_in_mib);
+  textures.ram_cache_size->store      (config.textures.ram_cache_in_mib);
+  textures.idle_prefetch->store       (config.textures.idle_prefetch);
+  textures.scene_prefetch->store      (config.textures.scene_prefetch);
+  textures.disk_cache_size->store     (config.textures.disk_in_mib);
+  textures.max_mip_drop->store        (config.textures.max_mip_drop);
+  textures.preview_size->store        (config.textures.preview_size);
+  textures.partition_ui->store        (config.textures.partitions.ui);
+  textures.partition_font->store      (config.textures.partitions.font);
+  textures.partition_blocking->store  (config.textures.partitions.blocking);
+  textures.partition_world->store     (config.textures.partitions.world);
+  textures.ui_textures->store         (config.textures.partitions.ui_crc32s);
 
 
   input.block_left_alt->store         (config.input.block_left_alt);
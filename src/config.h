@@ -88,7 +88,32 @@ struct tsf_config_s
     bool     log              = false;
     bool     full_mipmaps     = false;
     int      max_cache_in_mib = 1024;
+    int      min_cache_in_mib = 256;
+    bool     adaptive_cache   = true;
+    int      min_free_vram    = 128; // MiB
+    int      min_free_va      = 192; // MiB (largest contiguous block)
     int      max_decomp_jobs  = 16;
+    int      io_threads       = 2;    // Texture loads reading from disk at once
+    int      completion_us    = 1000; // Per-frame budget for finishing loads
+    int      upload_kib       = 0;    // Per-frame uploads by the render thread (0 = workers upload)
+    int      upload_us        = 2000; // Per-frame time for those uploads
+    bool     load_screens     = true; // Hook the game's PAC loader (throughput mode, scene prefetch)
+    int      shadow_in_mib    = 0;    // System memory copies kept for Reset
+    int      ram_cache_in_mib = 0;    // Decompressed data of evicted textures
+    bool     idle_prefetch    = true; // Refill the RAM cache while the game is idle
+    bool     scene_prefetch   = true; // Decode what an area used last time it loaded
+    int      disk_in_mib      = 0;    // Decompressed archive entries on disk
+    int      max_mip_drop     = 2;    // Top mip levels cold overrides can lose
+    int      preview_size     = 256;  // Small mips shown while large overrides load (0 = off)
+
+    struct {                          // <Min MiB>,<Max MiB>,<Never | Last | LRU>
+      std::wstring ui         = L"0,0,Never";
+      std::wstring font       = L"0,0,Never";
+      std::wstring blocking   = L"0,0,Never";
+      std::wstring world      = L"0,0,LRU";
+
+      std::wstring ui_crc32s  = L""; // Comma-separated, in hex
+    } partitions;
   } textures;
 
   struct {
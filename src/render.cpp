@@ -502,8 +502,24 @@ D3D9EndFrame_Post (HRESULT hr, IUnknown* device)
   if ((! tsf::window.active) && config.window.disable_bg_msaa)
     tsf::RenderFix::draw_state.use_msaa = false;
 
+  // Textures released during this frame are freed here, rather than on the
+  //   (much hotter) texture load path.
+  tsf::RenderFix::tex_mgr.flushRemoves ();
+  tsf::RenderFix::tex_mgr.updateBudget ();
+
+  // Loading screen or gameplay, this decides how aggressively to stream
+  extern void TSFix_UpdateLoadPhase (void);
+  TSFix_UpdateLoadPhase ();
+
+  // Deferred texture uploads go here, between frames rather than in one
+  extern void TSFix_UploadStagedTextures (void);
+  TSFix_UploadStagedTextures ();
+
+  // A purge scheduled by the budget controller has to run even when nothing
+  //   is streaming, or it would wait for the next texture load.
+  extern bool __need_purge;
   extern bool pending_loads (void);
-  if (pending_loads ()) {
+  if (pending_loads () || __need_purge) {
     extern void TSFix_LoadQueuedTextures (void);
     TSFix_LoadQueuedTextures ();
   }
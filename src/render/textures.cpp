@@ -30,6 +30,7 @@
 #include "../timing.h"
 #include "../hook.h"
 #include "../log.h"
+#include "../window.h"
 
 #include <atlbase.h>
 #include <cstdint>
@@ -42,6 +43,7 @@
 #include <lzma/7zCrc.h>
 #include <lzma/7zFile.h>
 #include <lzma/7zVersion.h>
+#include <lzma/XzCrc64.h>
 
 #define TSFIX_TEXTURE_DIR L"TSFix_Res"
 #define TSFIX_TEXTURE_EXT L".dds"
@@ -81,21 +83,36 @@ struct tsf_tex_record_s {
            int               fileno  = 0UL;
   enum     tsf_load_method_t method  = DontCare;
            size_t            size    = 0UL;
+           uint64_t          written = 0ULL; // Loose files: last write time (content index)
 };
 
-bool pending_loads            (void);
-void TSFix_LoadQueuedTextures (void);
+// Scheduling classes for texture loads, most urgent first
+enum tsf_tex_priority_t {
+  PriorityBlocking,  // Drawing cannot continue without it
+  PriorityVisible,   // In use right now, drawn at reduced quality until done
+  PriorityStreaming, // Ordinary streaming
+  PriorityPrefetch,  // Not needed yet (downgrades under memory pressure)
+  PriorityCount
+};
+
+bool pending_loads                (void);
+void TSFix_LoadQueuedTextures     (void);
+void TSFix_CompleteQueuedTextures (int budget_us);
+void TSFix_UploadStagedTextures   (void);
 
 #include <map>
 #include <set>
+#include <deque>
 #include <queue>
 #include <vector>
 #include <algorithm>
 #include <unordered_map>
 
 // All of the enumerated textures in TSFix_Textures/inject/...
+//   (only while enumerating, tex_policy answers every query after Init)
 std::unordered_map <uint32_t, tsf_tex_record_s> injectable_textures;
 std::vector        <std::wstring>               archives;
+std::vector        <uint32_t>                   archive_ids; // Name, size and mtime
 std::set           <uint32_t>                   dumped_textures;
 
 // The set of textures used during the last frame
@@ -106,6 +123,102 @@ std::set           <uint32_t>                   textures_used;
 //   (primarily to speed things up, but also for EULA-related reasons).
 std::set           <uint32_t>                   inject_blacklist;
 
+// Charged to the UI partition (UICRC32s, only until tex_policy is built)
+std::set           <uint32_t>                   ui_textures;
+
+enum {
+  TSFix_PolicyInject    = 0x1,
+  TSFix_PolicyDumped    = 0x2,
+  TSFix_PolicyBlacklist = 0x4,
+  TSFix_PolicyUI        = 0x8
+};
+
+struct tsf_tex_policy_s {
+  uint32_t                        checksum  = 0x00;
+  uint32_t                        flags     = 0x0;  // 0 = Empty slot
+  tsf::RenderFix::tex_partition_t partition = tsf::RenderFix::PartitionWorld;
+  tsf_tex_record_s                record;
+};
+
+//
+// Everything the load path needs to know about a checksum (injectable record,
+//   dumped, blacklisted, partition), answered by a single probe. Built once at
+//     the end of Init and never written again, so lookups need no lock.
+//
+class SK_TexturePolicyIndex {
+public:
+  void build (void)
+  {
+    std::unordered_map <uint32_t, uint32_t> flags;
+
+    for (auto it : injectable_textures) flags [it.first]  |= TSFix_PolicyInject;
+    for (auto it : dumped_textures)     flags [it]        |= TSFix_PolicyDumped;
+    for (auto it : inject_blacklist)    flags [it]        |= TSFix_PolicyBlacklist;
+    for (auto it : ui_textures)         flags [it]        |= TSFix_PolicyUI;
+
+    // Power-of-two and at most half full, CRC32s need no further hashing
+    size_t capacity = 16;
+
+    while (capacity < flags.size () * 2)
+      capacity <<= 1;
+
+    slots_.assign (capacity, tsf_tex_policy_s ());
+    mask_ = capacity - 1;
+
+    for (auto it : flags) {
+      size_t idx = it.first & mask_;
+
+      while (slots_ [idx].flags != 0x0)
+        idx = (idx + 1) & mask_;
+
+      slots_ [idx].checksum = it.first;
+      slots_ [idx].flags    = it.second;
+
+      if (it.second & TSFix_PolicyInject)
+        slots_ [idx].record = injectable_textures [it.first];
+
+      if (it.second & TSFix_PolicyUI)
+        slots_ [idx].partition = tsf::RenderFix::PartitionUI;
+      else if (slots_ [idx].record.method == Blocking)
+        slots_ [idx].partition = tsf::RenderFix::PartitionBlocking;
+    }
+  }
+
+  // nullptr if nothing is known about this checksum
+  const tsf_tex_policy_s* find (uint32_t checksum) const
+  {
+    if (slots_.empty ())
+      return nullptr;
+
+    size_t idx = checksum & mask_;
+
+    while (slots_ [idx].flags != 0x0) {
+      if (slots_ [idx].checksum == checksum)
+        return &slots_ [idx];
+
+      idx = (idx + 1) & mask_;
+    }
+
+    return nullptr;
+  }
+
+  const tsf_tex_record_s* injectable (uint32_t checksum) const
+  {
+    const tsf_tex_policy_s* policy = find (checksum);
+
+    if (policy != nullptr && (policy->flags & TSFix_PolicyInject))
+      return &policy->record;
+
+    return nullptr;
+  }
+
+  size_t size (void) const { return slots_.size (); }
+
+private:
+  std::vector <tsf_tex_policy_s> slots_;
+  size_t                         mask_ = 0;
+} tex_policy;
+
 std::wstring
 SK_D3D9_UsageToStr (DWORD dwUsage)
 {
@@ -361,6 +474,135 @@ SK_D3D9_FormatToStr (D3DFORMAT Format, bool include_ordinal = true)
   return std::wstring (L"UNKNOWN?!");
 }
 
+//
+// Bits per pixel; for block-compressed formats, this is the average over
+//   a 4x4 block (DXT1 = 4, DXT2-5 = 8).
+//
+UINT
+SK_D3D9_FormatBitsPerPixel (D3DFORMAT Format)
+{
+  switch (Format)
+  {
+    case D3DFMT_A32B32G32R32F:
+      return 128;
+
+    case D3DFMT_A16B16G16R16:
+    case D3DFMT_Q16W16V16U16:
+    case D3DFMT_A16B16G16R16F:
+    case D3DFMT_G32R32F:
+      return 64;
+
+    case D3DFMT_R8G8B8:
+      return 24;
+
+    case D3DFMT_R5G6B5:
+    case D3DFMT_X1R5G5B5:
+    case D3DFMT_A1R5G5B5:
+    case D3DFMT_A4R4G4B4:
+    case D3DFMT_A8R3G3B2:
+    case D3DFMT_X4R4G4B4:
+    case D3DFMT_A8P8:
+    case D3DFMT_A8L8:
+    case D3DFMT_V8U8:
+    case D3DFMT_L6V5U5:
+    case D3DFMT_UYVY:
+    case D3DFMT_YUY2:
+    case D3DFMT_R8G8_B8G8:
+    case D3DFMT_G8R8_G8B8:
+    case D3DFMT_D16_LOCKABLE:
+    case D3DFMT_D15S1:
+    case D3DFMT_D16:
+    case D3DFMT_L16:
+    case D3DFMT_INDEX16:
+    case D3DFMT_R16F:
+    case D3DFMT_CxV8U8:
+      return 16;
+
+    case D3DFMT_R3G3B2:
+    case D3DFMT_A8:
+    case D3DFMT_P8:
+    case D3DFMT_L8:
+    case D3DFMT_A4L4:
+    case D3DFMT_DXT2:
+    case D3DFMT_DXT3:
+    case D3DFMT_DXT4:
+    case D3DFMT_DXT5:
+#if !defined(D3D_DISABLE_9EX)
+    case D3DFMT_S8_LOCKABLE:
+#endif
+      return 8;
+
+    case D3DFMT_DXT1:
+      return 4;
+
+#if !defined(D3D_DISABLE_9EX)
+    case D3DFMT_A1:
+      return 1;
+#endif
+
+    // Everything else is 32-bit (or close enough to it)
+    default:
+      return 32;
+  }
+}
+
+//
+// What a single surface actually occupies in VRAM, as opposed to the size of
+//   the (usually compressed) file it was loaded from. Row pitch padding is
+//     driver-specific and not accounted for.
+//
+size_t
+SK_D3D9_SurfaceFootprint (const D3DSURFACE_DESC& desc)
+{
+  size_t size = 0;
+
+  switch (desc.Format)
+  {
+    case D3DFMT_DXT1:
+    case D3DFMT_DXT2:
+    case D3DFMT_DXT3:
+    case D3DFMT_DXT4:
+    case D3DFMT_DXT5:
+    {
+      size_t blocks_x = std::max (1U, (desc.Width  + 3) / 4);
+      size_t blocks_y = std::max (1U, (desc.Height + 3) / 4);
+
+      size = blocks_x * blocks_y * (desc.Format == D3DFMT_DXT1 ? 8 : 16);
+    } break;
+
+    default:
+    {
+      size = ( (size_t)desc.Width * desc.Height *
+                 SK_D3D9_FormatBitsPerPixel (desc.Format) + 7 ) / 8;
+    } break;
+  }
+
+  // Every sample is stored
+  if (desc.MultiSampleType >= D3DMULTISAMPLE_2_SAMPLES)
+    size *= (size_t)desc.MultiSampleType;
+
+  return size;
+}
+
+size_t
+SK_D3D9_TextureFootprint (IDirect3DTexture9* pTex)
+{
+  if (pTex == nullptr)
+    return 0;
+
+  size_t size   = 0;
+  DWORD  levels = pTex->GetLevelCount ();
+
+  for (DWORD i = 0; i < levels; i++) {
+    D3DSURFACE_DESC desc;
+
+    if (SUCCEEDED (pTex->GetLevelDesc (i, &desc)))
+      size += SK_D3D9_SurfaceFootprint (desc);
+  }
+
+  return size;
+}
+
 const wchar_t*
 SK_D3D9_PoolToStr (D3DPOOL pool)
 {
@@ -604,6 +846,11 @@ FlushOrphanedRTs (void)
 int debug_tex_id;
 uint32_t current_tex;
 
+bool TSFix_ReloadOverride (ISKTextureD3D9* pSKTex, UINT skip_mips, tsf_tex_priority_t priority);
+void TSFix_BlockOnLoad    (ISKTextureD3D9* pSKTex);
+void TSFix_PromoteLoad    (ISKTextureD3D9* pSKTex);
+bool is_streaming         (uint32_t checksum);
+
 COM_DECLSPEC_NOTHROW
 HRESULT
 STDMETHODCALLTYPE
@@ -635,20 +882,27 @@ D3D9SetTexture_Detour (
 
     QueryPerformanceCounter_Original (&pSKTex->last_used);
 
+    // Downgraded under memory pressure (or a preview), now that it is in
+    //   use again it should get its top mip levels back. Asked for once per
+    //     installed override; if that cannot be queued or fails, it keeps
+    //       what it has rather than trying again on every bind.
+    if ( pSKTex->override_lod > 0 && __remap_textures &&
+         (! pSKTex->restore_pending)                  &&
+         (! is_streaming (pSKTex->tex_crc32)) ) {
+      pSKTex->restore_pending = true;
+
+      TSFix_ReloadOverride (pSKTex, 0, PriorityVisible);
+    }
+
     //
     // This is how blocking is implemented -- only do it when a texture that needs
     //                                          this feature is being applied.
     //
-    while ( __remap_textures && pSKTex->must_block &&
-                                pSKTex->pTexOverride == nullptr ) {
-      //
-      /// What was I smoking?! This will deadlock
-      //
-      //if (pending_loads ()) /// UNCONDITIONALLY DO THIS!
-        TSFix_LoadQueuedTextures ();
-      //else {
-        //YieldProcessor ();
-      //}
+    if ( __remap_textures && pSKTex->pTexOverride == nullptr ) {
+      if (pSKTex->must_block)
+        TSFix_BlockOnLoad (pSKTex);
+      else
+        TSFix_PromoteLoad (pSKTex);
     }
 
     if (__remap_textures && pSKTex->pTexOverride != nullptr)
@@ -1120,11 +1374,14 @@ D3DXCreateTextureFromFileEx_pfn
 #define D3DX_SKIP_DDS_MIP_LEVELS(l, f) ((((l) & D3DX_SKIP_DDS_MIP_LEVELS_MASK) \
 << D3DX_SKIP_DDS_MIP_LEVELS_SHIFT) | ((f) == D3DX_DEFAULT ? D3DX_FILTER_BOX : (f)))
 
+class SK_TextureWorkerThread;
+
 struct tsf_tex_load_s {
   enum {
     Stream,    // This load will be streamed
     Immediate, // This load must finish immediately   (pSrc is unused)
-    Resample   // Change image properties             (pData is supplied)
+    Resample,  // Change image properties             (pData is supplied)
+    Preview    // Small mips of a Stream load, shown until it is done
   } type;
 
   LPDIRECT3DDEVICE9   pDevice;
@@ -1134,358 +1391,1328 @@ struct tsf_tex_load_s {
   UINT                SrcDataSize;
 
   uint32_t            checksum;
-  uint32_t            size;
+  uint32_t            size;              // Counted in streaming_bytes while in-flight
 
-  // Stream / Immediate
-  wchar_t             wszFilename [MAX_PATH];
+  UINT                skip_mips = 0;     // Top mip levels to leave out (downgrade)
+  uint64_t            content   = 0ULL;  // Hash of the payload (0 = unknown)
+  bool                user_font = false; // From font.dds, whatever the texture packs have
 
-  LPDIRECT3DTEXTURE9  pDest = nullptr;
-  LPDIRECT3DTEXTURE9  pSrc  = nullptr;
+  // Scheduling
+  enum {
+    Pending,   // Not handed to the scheduler (yet), e.g. a Reset shadow restore
+    Queued,
+    Running,
+    Finished   // Waiting for the render thread to complete it
+  };
+
+  tsf_tex_priority_t      priority  = PriorityStreaming;
+  LARGE_INTEGER           queued    = { 0LL };   // Posted to the scheduler (aging)
+  volatile LONG           stage     = Pending;
+  SK_TextureWorkerThread* worker    = nullptr;   // Whose queue it is waiting in
+  volatile HANDLE         done      = nullptr;   // Signaled once Finished (or previewed), if anyone waits
+  volatile LONG           cancelled = FALSE;     // Its texture died first
+  tsf_tex_load_s*         next      = nullptr;   // Link in whichever queue holds it
+
+  // Pipeline, handed from stage to stage along with the job
+  enum {
+    FromFile,      // Loose file
+    FromArchive,   // Compressed folder, until the decode stage is done with it
+    FromRAMCache,
+    FromDiskCache
+  }                       source    = FromFile;
+  const tsf_tex_record_s* record    = nullptr;   // Looked up by the I/O stage
+  void*                   buffer    = nullptr;   // streaming_memory, pSrcData points into it
+  D3DXIMAGE_INFO          info      = { };       // Read by the decode stage
+  bool                    staged    = false;     // pSrc is in D3DPOOL_SYSTEMMEM, uploaded by the render thread
+
+  // Textures from the same solid folder are read and decoded together
+  uint64_t                folder_key  = 0ULL;     // TSFix_FolderKey (...), 0 = not looked up yet
+  tsf_tex_load_s*         folder_next = nullptr;  // Decoded along with this one, by offset
+  HRESULT                 status      = E_FAIL;   // Its decode, when it rode along
+
+  LPDIRECT3DTEXTURE9  pDest   = nullptr;
+  LPDIRECT3DTEXTURE9  pSrc    = nullptr;
+  LPDIRECT3DTEXTURE9  pShadow = nullptr; // D3DPOOL_SYSTEMMEM copy of pSrc
+
+  // Later requests for the same checksum, linked through next_waiter
+  ISKTextureD3D9* volatile
+                      waiters = nullptr;
 
   LARGE_INTEGER       start = { 0LL };
   LARGE_INTEGER       end   = { 0LL };
   LARGE_INTEGER       freq  = { 0LL };
 };
 
+volatile LONG cancelled_loads = 0L;
+volatile LONG preview_loads   = 0L;  // Shown at reduced resolution first
+volatile LONG preview_bytes   = 0L;  // Their footprint, in KiB
 
-class TexLoadRef {
+//
+// Tells loading screens from gameplay. The game loads its PAC files in
+//   bursts while a loading screen is up, and frames come irregularly there;
+//     streaming is all about throughput then, and stays out of the way of
+//       the render thread otherwise.
+//
+class SK_LoadPhaseDetector {
 public:
-   TexLoadRef (tsf_tex_load_s* ref) { ref_ = ref;}
-  ~TexLoadRef (void) { }
+  // Any thread, whichever one the game loads from
+  void notePAC (void)
+  {
+    InterlockedExchange  (&last_pac_, (LONG)timeGetTime ());
+    InterlockedIncrement (&pacs_);
 
-  operator tsf_tex_load_s* (void) {
-    return ref_;
+    InterlockedExchange  (&loading_, 1L);
   }
 
-protected:
-  tsf_tex_load_s* ref_;
-};
-
-class SK_TextureThreadPool;
-
-class SK_TextureWorkerThread {
-friend class SK_TextureThreadPool;
-public:
-  SK_TextureWorkerThread (SK_TextureThreadPool* pool)
+  // Render thread, once per frame
+  void noteFrame (void)
   {
-    pool_ = pool;
-    job_  = nullptr;
-
-    control_.start =
-      CreateEvent (nullptr, FALSE, FALSE, nullptr);
-    control_.trim =
-      CreateEvent (nullptr, FALSE, FALSE, nullptr);
-    control_.shutdown =
-      CreateEvent (nullptr, FALSE, FALSE, nullptr);
+    const DWORD now = timeGetTime ();
 
-    thread_ =
-      (HANDLE)_beginthreadex ( nullptr,
-                                 0,
-                                   ThreadProc,
-                                     this,
-                                       0x00,
-                                         (unsigned int *)&thread_id_ );
-  }
+    if (last_frame_ != 0 && now - last_frame_ > SLOW_FRAME_MS)
+      steady_ = 0;
+    else
+      ++steady_;
 
-  ~SK_TextureWorkerThread (void)
-  {
-    shutdown ();
+    last_frame_ = now;
 
-    WaitForSingleObject (thread_, INFINITE);
+    // Back to gameplay once the PAC loads stop and frames are regular again
+    if ( loading_ && now - (DWORD)last_pac_ > PAC_HOLD_MS &&
+                     steady_                 >= STEADY_FRAMES )
+      InterlockedExchange (&loading_, 0L);
 
-    CloseHandle (control_.shutdown);
-    CloseHandle (control_.trim);
-    CloseHandle (control_.start);
+    const bool loading = (loading_ != 0L);
 
-    CloseHandle (thread_);
-  }
+    if (loading != reported_) {
+      if (loading) {
+        entered_ = now;
+        ++screens_;
+      } else {
+        loading_ms_ += now - entered_;
+      }
 
-  void startJob  (tsf_tex_load_s* job) {
-    job_ = job;
-    SetEvent (control_.start);
-  }
+      tex_log->Log ( L"[ Tex. Mgr ] %s, texture streaming favors %s",
+                       loading ? L"Loading screen" :
+                                 L"Gameplay",
+                         loading ? L"throughput" :
+                                   L"the render thread" );
 
-  void trim (void) {
-    SetEvent (control_.trim);
+      reported_ = loading;
+    }
   }
 
-  void finishJob (void);
+  bool loading (void) const { return loading_ != 0L; }
 
-  bool isBusy   (void) {
-    return (job_ != nullptr);
-  }
+  ULONG screens   (void) const { return screens_; }
+  LONG  pacs      (void) const { return pacs_;    }
 
-  void shutdown (void) {
-    SetEvent (control_.shutdown);
-  }
+  // Including the one in progress
+  double loadingSecs (void) const
+  {
+    DWORD ms = loading_ms_;
 
-protected:
-  static CRITICAL_SECTION cs_worker_init;
-  static ULONG            num_threads_init;
+    if (reported_)
+      ms += timeGetTime () - entered_;
 
-  static unsigned int __stdcall ThreadProc (LPVOID user);
+    return (double)ms / 1000.0;
+  }
 
-  SK_TextureThreadPool* pool_;
+private:
+  static const DWORD PAC_HOLD_MS   = 750UL; // No PAC loads for this long...
+  static const DWORD SLOW_FRAME_MS =  50UL; // ...and no frame slower than this...
+  static const int   STEADY_FRAMES =  10;   // ...for this many frames in a row
 
-  unsigned int          thread_id_;
-  HANDLE                thread_;
+  volatile LONG loading_    = 0L;
+  volatile LONG last_pac_   = 0L;
+  volatile LONG pacs_       = 0L;
 
-  tsf_tex_load_s*       job_;
+  DWORD         last_frame_ = 0UL;
+  int           steady_     = 0;
+  bool          reported_   = false;
+  DWORD         entered_    = 0UL;
+  DWORD         loading_ms_ = 0UL;
+  ULONG         screens_    = 0UL;
+} load_phase;
 
-  struct {
-    union {
-      struct {
-        HANDLE start;
-        HANDLE trim;
-        HANDLE shutdown;
-      };
-      HANDLE   ops [3];
-    };
-  } control_;
-};
+void TSFix_PredictScene (const char* szName);
 
-class SK_TextureThreadPool {
-friend class SK_TextureWorkerThread;
-public:
-  SK_TextureThreadPool (void) {
-    events_.jobs_added =
-      CreateEvent (nullptr, FALSE, FALSE, nullptr);
+// Called by the game's PAC loader hook
+void
+TSFix_NoteLoadPAC (const char* szName)
+{
+  load_phase.notePAC ();
 
-    events_.results_waiting =
-      CreateEvent (nullptr, FALSE, FALSE, nullptr);
+  TSFix_PredictScene (szName);
+}
 
-    events_.shutdown =
-      CreateEvent (nullptr, FALSE, FALSE, nullptr);
+void
+TSFix_UpdateLoadPhase (void)
+{
+  load_phase.noteFrame ();
+}
 
-    InitializeCriticalSectionAndSpinCount (&cs_jobs,      10UL);
-    InitializeCriticalSectionAndSpinCount (&cs_results, 1000UL);
+//
+// Only the references TSFix holds are left: the one a load job adds, and the
+//   texture cache's. Purges never drop the latter while a load is in-flight.
+//
+static inline bool
+TSFix_Unreferenced (ISKTextureD3D9* pSKTex)
+{
+  return pSKTex->refs <= (pSKTex->cached ? 2UL : 1UL);
+}
 
-    const int MAX_THREADS = config.textures.max_decomp_jobs;
+//
+// The game let go of the texture this load is for and nothing attached to
+//   it since, so there is no point finishing it. Checked before a job starts
+//     and between stages, by the render thread and workers alike.
+//
+bool
+TSFix_LoadCancelled (tsf_tex_load_s* load)
+{
+  if (load->cancelled)
+    return true;
 
-    static bool init_worker_sync = false;
-    if (! init_worker_sync) {
-      // We will add a sync. barrier that waits for all of the threads in this pool, plus all of the threads
-      //   in the other pool to initialize. This design is flawed, but safe.
-      InitializeCriticalSectionAndSpinCount (&SK_TextureWorkerThread::cs_worker_init, 10000UL);
-      init_worker_sync = true;
-    }
+  if ( TSFix_Unreferenced ((ISKTextureD3D9 *)load->pDest) &&
+       load->waiters == nullptr ) {
+    if (InterlockedCompareExchange (&load->cancelled, TRUE, FALSE) == FALSE)
+      InterlockedIncrement (&cancelled_loads);
+  }
 
-    for (int i = 0; i < MAX_THREADS; i++) {
-      SK_TextureWorkerThread* pWorker =
-        new SK_TextureWorkerThread (this);
+  return load->cancelled != FALSE;
+}
 
-      workers_.push_back (pWorker);
-    }
+//
+// FIFO of load jobs linked through tsf_tex_load_s::next, for one thread (or
+//   under a lock); never allocates.
+//
+class SK_LoadList {
+public:
+  bool   empty (void) const { return head_ == nullptr; }
+  size_t size  (void) const { return count_;           }
 
-    // This will be deferred until it is first needed...
-    spool_thread_ = nullptr;
-  }
+  tsf_tex_load_s* front (void) const { return head_; }
 
-  ~SK_TextureThreadPool (void) {
-    if (spool_thread_ != nullptr) {
-      shutdown ();
+  void push_back (tsf_tex_load_s* load)
+  {
+    load->next = nullptr;
 
-      WaitForSingleObject (spool_thread_, INFINITE);
-      CloseHandle         (spool_thread_);
-    }
+    if (tail_ != nullptr)
+      tail_->next = load;
+    else
+      head_       = load;
 
-    DeleteCriticalSection (&cs_results);
-    DeleteCriticalSection (&cs_jobs);
+    tail_ = load;
 
-    CloseHandle (events_.results_waiting);
-    CloseHandle (events_.jobs_added);
-    CloseHandle (events_.shutdown);
+    ++count_;
   }
 
-  void postJob (tsf_tex_load_s* job)
+  void push_front (tsf_tex_load_s* load)
   {
-    EnterCriticalSection (&cs_jobs);
-    {
-      // Defer the creation of this until the first job is posted
-      if (! spool_thread_) {
-        spool_thread_ =
-          (HANDLE)_beginthreadex ( nullptr,
-                                     0,
-                                       Spooler,
-                                         this,
-                                           0x00,
-                                             nullptr );
-      }
+    load->next = head_;
+    head_      = load;
 
-      // Don't let the game free this while we are working on it...
-      job->pDest->AddRef ();
+    if (tail_ == nullptr)
+      tail_ = load;
 
-      jobs_.push (job);
-      SetEvent   (events_.jobs_added);
-    }
-    LeaveCriticalSection (&cs_jobs);
+    ++count_;
   }
 
-  std::vector <tsf_tex_load_s *> getFinished (void)
+  tsf_tex_load_s* pop_front (void)
   {
-    std::vector <tsf_tex_load_s *> results;
+    tsf_tex_load_s* load = head_;
 
-    DWORD dwResults =
-      WaitForSingleObject (events_.results_waiting, 0);
+    if (load != nullptr) {
+      head_ = load->next;
 
-    // Nothing waiting
-    if (dwResults != WAIT_OBJECT_0)
-      return results;
+      if (head_ == nullptr)
+        tail_ = nullptr;
 
-    EnterCriticalSection (&cs_results);
-    {
-      while (! results_.empty ()) {
-        results.push_back (results_.front ());
-                           results_.pop   ();
-      }
+      load->next = nullptr;
+
+      --count_;
     }
-    LeaveCriticalSection (&cs_results);
 
-    return results;
+    return load;
   }
 
-  bool working (void) {
-    return (! results_.empty ());
-  }
+  bool remove (tsf_tex_load_s* load)
+  {
+    tsf_tex_load_s* prev = nullptr;
 
-  int queueLength (void) {
-    int num = 0;
+    for (tsf_tex_load_s* it = head_; it != nullptr; prev = it, it = it->next) {
+      if (it != load)
+        continue;
 
-    EnterCriticalSection (&cs_jobs);
-    {
-      num = jobs_.size ();
+      if (prev != nullptr)
+        prev->next = it->next;
+      else
+        head_      = it->next;
+
+      if (tail_ == it)
+        tail_ = prev;
+
+      it->next = nullptr;
+
+      --count_;
+
+      return true;
     }
-    LeaveCriticalSection (&cs_jobs);
 
-    return num;
+    return false;
   }
 
-  void shutdown (void) {
-    SetEvent (events_.shutdown);
-  }
+private:
+  tsf_tex_load_s* head_  = nullptr;
+  tsf_tex_load_s* tail_  = nullptr;
+  size_t          count_ = 0;
+};
 
+//
+// Multi-producer / single-consumer queue of load jobs, linked through
+//   tsf_tex_load_s::next. Producers push with one CAS, the consumer takes
+//     everything at once with one exchange; an empty poll is one load.
+//
+class SK_LoadQueue {
+public:
+  bool empty (void) const { return head_ == nullptr; }
 
-protected:
-  static unsigned int __stdcall Spooler (LPVOID user);
+  void push (tsf_tex_load_s* load)
+  {
+    tsf_tex_load_s* head = head_;
 
-  tsf_tex_load_s* getNextJob   (void) {
-    tsf_tex_load_s* job       = nullptr;
-    DWORD           dwResults = 0;
+    for (;;) {
+      load->next = head;
 
-    //while (dwResults != WAIT_OBJECT_0) {
-      //dwResults = WaitForSingleObject (events_.jobs_added, INFINITE);
-    //}
+      tsf_tex_load_s* prev =
+        (tsf_tex_load_s *)InterlockedCompareExchangePointer ( (PVOID volatile *)&head_,
+                                                                load,
+                                                                  head );
 
-    if (jobs_.empty ())
-      return nullptr;
+      if (prev == head)
+        break;
 
-    EnterCriticalSection (&cs_jobs);
-    {
-      job = jobs_.front ();
-            jobs_.pop   ();
+      head = prev;
     }
-    LeaveCriticalSection (&cs_jobs);
-
-    return job;
   }
 
-  void            postFinished (tsf_tex_load_s* finished)
+  // Consumer only: moves everything pushed so far to the end of out, in order
+  void drain (SK_LoadList& out)
   {
-    EnterCriticalSection (&cs_results);
-    {
-      // Remove the temporary reference we added earlier
-      finished->pDest->Release ();
+    if (head_ == nullptr)
+      return;
 
-      results_.push (finished);
-      SetEvent      (events_.results_waiting);
-    }
-    LeaveCriticalSection (&cs_results);
-  }
+    tsf_tex_load_s* lifo =
+      (tsf_tex_load_s *)InterlockedExchangePointer ((PVOID volatile *)&head_, nullptr);
 
-private:
-  std::queue <TexLoadRef> jobs_;
-  std::queue <TexLoadRef> results_;
+    // Pushed newest first
+    tsf_tex_load_s* fifo = nullptr;
 
-  std::vector <SK_TextureWorkerThread *> workers_;
+    while (lifo != nullptr) {
+      tsf_tex_load_s* next = lifo->next;
 
-  struct {
-    HANDLE jobs_added;
-    HANDLE results_waiting;
-    HANDLE shutdown;
-  } events_;
+      lifo->next = fifo;
+      fifo       = lifo;
+      lifo       = next;
+    }
 
-  CRITICAL_SECTION cs_jobs;
-  CRITICAL_SECTION cs_results;
+    while (fifo != nullptr) {
+      tsf_tex_load_s* next = fifo->next;
 
-  HANDLE spool_thread_;
-};
+      out.push_back (fifo);
 
+      fifo = next;
+    }
+  }
+
+private:
+  tsf_tex_load_s* volatile head_ = nullptr;
+};
 
 //
-// Split stream jobs into small and large in order to prevent
-//   starvation from wreaking havoc on load times.
-//
-//   This is a simple, but remarkably effective approach and
-//     further optimization work probably will not be done.
+// Load jobs are recycled instead of going through the heap for every
+//   texture; a burst of loads leaves at most max_free_ of them behind.
 //
-struct SK_StreamSplitter {
-  bool working (void) {
-    if (lrg_tex && lrg_tex->working ())
-      return true;
+class SK_TextureLoadPool {
+public:
+  void init (void)
+  {
+    InitializeCriticalSectionAndSpinCount (&cs_loads, 1000UL);
+  }
 
-    if (sm_tex && sm_tex->working ())
-      return true;
+  void shutdown (void)
+  {
+    for (auto it : free_)
+      delete it;
 
-    return false;
+    free_.clear ();
+
+    DeleteCriticalSection (&cs_loads);
   }
 
-  int queueLength (void) {
-    int len = 0;
+  tsf_tex_load_s* alloc (void)
+  {
+    tsf_tex_load_s* load = nullptr;
+
+    EnterCriticalSection (&cs_loads);
+    {
+      if (! free_.empty ()) {
+        load = free_.back ();
+        free_.pop_back ();
+      }
+    }
+    LeaveCriticalSection (&cs_loads);
+
+    if (load == nullptr)
+      return new tsf_tex_load_s ();
 
-    if (lrg_tex) len += lrg_tex->queueLength ();
-    if (sm_tex)  len += sm_tex->queueLength  ();
+    *load = tsf_tex_load_s ();
 
-    return len;
+    return load;
   }
 
-  std::vector <tsf_tex_load_s *> getFinished (void)
+  void free (tsf_tex_load_s* load)
   {
-    std::vector <tsf_tex_load_s *> results;
+    EnterCriticalSection (&cs_loads);
+    {
+      if (free_.size () < max_free_) {
+        free_.push_back (load);
+        load = nullptr;
+      }
+    }
+    LeaveCriticalSection (&cs_loads);
 
-    std::vector <tsf_tex_load_s *> lrg_loads;
-    std::vector <tsf_tex_load_s *> sm_loads;
+    if (load != nullptr)
+      delete load;
+  }
 
-    if (lrg_tex) lrg_loads = lrg_tex->getFinished ();
-    if (sm_tex)  sm_loads  = sm_tex->getFinished  ();
+private:
+  static const size_t            max_free_ = 64;
 
-    results.insert (results.begin (), lrg_loads.begin (), lrg_loads.end ());
-    results.insert (results.begin (), sm_loads.begin  (), sm_loads.end  ());
+  std::vector <tsf_tex_load_s *> free_;
+  CRITICAL_SECTION               cs_loads;
+} load_pool;
 
-    return results;
-  }
 
-  void postJob (tsf_tex_load_s* job)
+HRESULT  TSFix_ReadTexture   (tsf_tex_load_s* load);
+uint64_t TSFix_FolderKey     (uint32_t checksum);
+HRESULT TSFix_DecodeTexture (tsf_tex_load_s* load);
+HRESULT TSFix_DecodeStage   (tsf_tex_load_s* load);
+HRESULT TSFix_CreateTexture (tsf_tex_load_s* load);
+
+//
+// Throughput and utilization of one stage of the load pipeline; sample ()
+//   updates the rates, measured since it was last called.
+//
+class SK_TextureStageStats {
+public:
+  void record (LONGLONG busy_ticks, size_t bytes, LONG items = 1L)
   {
-    // A "Large" load is one >= 128 KiB
-    if (job->SrcDataSize > (128 * 1024))
-      lrg_tex->postJob (job);
-    else
-      sm_tex->postJob (job);
+    InterlockedExchangeAdd64 (&busy_ticks_, busy_ticks);
+    InterlockedExchangeAdd64 (&bytes_,      bytes);
+    InterlockedExchangeAdd   (&items_,      items);
   }
 
-  SK_TextureThreadPool* lrg_tex = nullptr;
-  SK_TextureThreadPool* sm_tex  = nullptr;
-} stream_pool;
+  void sample (int threads)
+  {
+    LARGE_INTEGER freq, now;
 
+    QueryPerformanceFrequency        (&freq);
+    QueryPerformanceCounter_Original (&now);
 
-std::queue <TexLoadRef> textures_to_resample;
+    if (last_.QuadPart == 0LL) {
+      last_ = now;
+      return;
+    }
 
-std::map   <uint32_t, tsf_tex_load_s *>
-                              textures_in_flight;
+    double secs =
+      (double)(now.QuadPart - last_.QuadPart) / (double)freq.QuadPart;
 
-CRITICAL_SECTION              cs_tex_stream;
-CRITICAL_SECTION              cs_tex_resample;
-CRITICAL_SECTION              cs_tex_inject;
+    // Too short to say anything, keep the previous rates
+    if (secs < 0.25)
+      return;
+
+    LONG   items = InterlockedExchange   (&items_,      0L);
+    LONG64 bytes = InterlockedExchange64 (&bytes_,      0LL);
+    LONG64 busy  = InterlockedExchange64 (&busy_ticks_, 0LL);
+
+    total_items_ += items;
+    total_bytes_ += bytes;
+    total_busy_  += (double)busy / (double)freq.QuadPart;
+    total_secs_  += secs;
+
+    per_sec_  = (double)items / secs;
+    mib_sec_  = (double)bytes / secs / (1024.0 * 1024.0);
+    busy_pct_ = 100.0 * (double)busy / (double)freq.QuadPart /
+                          (secs * std::max (1, threads));
+
+    last_ = now;
+  }
+
+  double perSec  (void) const { return per_sec_;  }
+  double mibSec  (void) const { return mib_sec_;  }
+  double busyPct (void) const { return busy_pct_; }
+
+  bool   used    (void) const { return total_items_ > 0 || items_ > 0; }
+
+  // Since the pipeline started (up to the last sample)
+  LONG64 totalItems (void) const { return total_items_; }
+  double totalMiB   (void) const { return (double)total_bytes_ / (1024.0 * 1024.0); }
+
+  double totalBusyPct (int threads) const {
+    return total_secs_ > 0.0 ?
+      100.0 * total_busy_ / (total_secs_ * std::max (1, threads)) : 0.0;
+  }
+
+private:
+  volatile LONG64 busy_ticks_  = 0LL;
+  volatile LONG64 bytes_       = 0LL;
+  volatile LONG   items_       = 0L;
+
+  LARGE_INTEGER   last_        = { 0LL };
+  double          per_sec_     = 0.0;
+  double          mib_sec_     = 0.0;
+  double          busy_pct_    = 0.0;
+
+  LONG64          total_items_ = 0LL;
+  LONG64          total_bytes_ = 0LL;
+  double          total_busy_  = 0.0;
+  double          total_secs_  = 0.0;
+};
+
+class SK_TextureScheduler;
+class SK_TextureArchive;
+
+//
+// A stage of the load pipeline after the scheduler's I/O workers: its own
+//   threads and a bounded queue per priority class (no aging, the scheduler
+//     already decided the order). Posting to a full stage waits, so a slow
+//       stage holds back the ones before it instead of letting decompressed
+//         buffers pile up.
+//
+class SK_TexturePipelineStage {
+public:
+  typedef HRESULT (*step_pfn)(tsf_tex_load_s* load);
+
+  void init ( SK_TextureScheduler*     sched,
+              HANDLE                   shutdown,
+              step_pfn                 step,
+              SK_TexturePipelineStage* next,
+              int                      threads,
+              LONG                     capacity,
+              bool                     background )
+  {
+    sched_      = sched;
+    shutdown_   = shutdown;
+    step_       = step;
+    next_       = next;
+    background_ = background;
+
+    items_ = CreateSemaphore (nullptr, 0,        MAXLONG,  nullptr);
+    slots_ = CreateSemaphore (nullptr, capacity, capacity, nullptr);
+
+    InitializeCriticalSectionAndSpinCount (&cs_queue, 1000UL);
+
+    for (int i = 0; i < threads; i++) {
+      threads_.push_back (
+        (HANDLE)_beginthreadex ( nullptr,
+                                   0,
+                                     ThreadProc,
+                                       this,
+                                         0x00,
+                                           nullptr )
+      );
+    }
+  }
+
+  // Waits for room; false if the pipeline is shutting down instead
+  bool post (tsf_tex_load_s* job)
+  {
+    HANDLE waits [2] = { slots_, shutdown_ };
+
+    if (WaitForMultipleObjects (2, waits, FALSE, INFINITE) != WAIT_OBJECT_0)
+      return false;
+
+    EnterCriticalSection (&cs_queue);
+    {
+      queues_ [job->priority].push_back (job);
+    }
+    LeaveCriticalSection (&cs_queue);
+
+    InterlockedIncrement (&depth_);
+
+    ReleaseSemaphore (items_, 1, nullptr);
+
+    return true;
+  }
+
+  // Moves a job waiting in this stage to the front of the Blocking class
+  bool hurry (tsf_tex_load_s* job)
+  {
+    bool moved = false;
+
+    EnterCriticalSection (&cs_queue);
+    {
+      if (queues_ [job->priority].remove (job)) {
+        job->priority = PriorityBlocking;
+        queues_ [PriorityBlocking].push_front (job);
+
+        moved = true;
+      }
+    }
+    LeaveCriticalSection (&cs_queue);
+
+    return moved;
+  }
+
+  LONG depth   (void) const { return depth_;                }
+  int  threads (void) const { return (int)threads_.size (); }
+
+  SK_TextureStageStats stats;
+
+protected:
+  static unsigned int __stdcall ThreadProc (LPVOID user);
+
+  tsf_tex_load_s* take (void)
+  {
+    tsf_tex_load_s* job = nullptr;
+
+    EnterCriticalSection (&cs_queue);
+    {
+      for (int cls = 0; cls < PriorityCount && job == nullptr; cls++)
+        job = queues_ [cls].pop_front ();
+    }
+    LeaveCriticalSection (&cs_queue);
+
+    if (job != nullptr) {
+      InterlockedDecrement (&depth_);
+
+      ReleaseSemaphore (slots_, 1, nullptr);
+    }
+
+    return job;
+  }
+
+private:
+  SK_TextureScheduler*     sched_      = nullptr;
+  step_pfn                 step_       = nullptr;
+  SK_TexturePipelineStage* next_       = nullptr;
+  bool                     background_ = false;   // Large streamed loads run in background mode
+
+  std::vector <HANDLE>     threads_;
+
+  HANDLE                   items_      = nullptr;
+  HANDLE                   slots_      = nullptr;
+  HANDLE                   shutdown_   = nullptr;  // The scheduler's
+
+  CRITICAL_SECTION         cs_queue;
+  SK_LoadList              queues_ [PriorityCount];
+  volatile LONG            depth_      = 0L;
+};
+
+class TexLoadRef {
+public:
+   TexLoadRef (tsf_tex_load_s* ref) { ref_ = ref;}
+  ~TexLoadRef (void) { }
+
+  operator tsf_tex_load_s* (void) {
+    return ref_;
+  }
+
+protected:
+  tsf_tex_load_s* ref_;
+};
+
+//
+// Each worker owns a queue per priority class; workers whose own queues are
+//   empty (or hold nothing as urgent) steal from the others.
+//
+class SK_TextureWorkerThread {
+friend class SK_TextureScheduler;
+public:
+  SK_TextureWorkerThread (SK_TextureScheduler* sched)
+  {
+    sched_ = sched;
+
+    InitializeCriticalSectionAndSpinCount (&cs_queue, 1000UL);
+
+    thread_ =
+      (HANDLE)_beginthreadex ( nullptr,
+                                 0,
+                                   ThreadProc,
+                                     this,
+                                       0x00,
+                                         (unsigned int *)&thread_id_ );
+  }
+
+  ~SK_TextureWorkerThread (void)
+  {
+    WaitForSingleObject (thread_, INFINITE);
+
+    CloseHandle           (thread_);
+    DeleteCriticalSection (&cs_queue);
+  }
+
+protected:
+  static ULONG            num_threads_init;
+  static ULONG            num_threads;
+
+  static unsigned int __stdcall ThreadProc (LPVOID user);
+
+  SK_TextureScheduler*          sched_;
+
+  unsigned int                  thread_id_;
+  HANDLE                        thread_;
+
+  // cs_queue must be held; moves newly posted jobs into their class queues
+  void drainInbox (void)
+  {
+    if (inbox_.empty ())
+      return;
+
+    SK_LoadList posted;
+    inbox_.drain (posted);
+
+    while (! posted.empty ()) {
+      tsf_tex_load_s* job = posted.pop_front ();
+
+      queues_ [job->priority].push_back (job);
+    }
+  }
+
+  SK_LoadQueue                  inbox_;   // Posted, lock-free
+  CRITICAL_SECTION              cs_queue;
+  SK_LoadList                   queues_ [PriorityCount];
+  volatile LONG                 queued_ = 0L;
+};
+
+//
+// Replaces the small / large texture split: one set of workers, explicit
+//   priority classes, and aging so that nothing waits forever behind a
+//     steady stream of more urgent work.
+//
+//   The workers are the first stage of a pipeline: I/O -> decode (LZMA and
+//     the image header) -> create. Each stage has its own threads, so a slow
+//       read no longer idles a decoder and vice versa.
+//
+class SK_TextureScheduler {
+friend class SK_TextureWorkerThread;
+friend class SK_TexturePipelineStage;
+public:
+  enum {
+    StageIO,
+    StageDecode,
+    StageCreate,
+    StageCount
+  };
+
+  void init (int io_workers, int decoders, int creators)
+  {
+    work_available_ =
+      CreateSemaphore (nullptr, 0, MAXLONG, nullptr);
+
+    shutdown_ =
+      CreateEvent (nullptr, TRUE, FALSE, nullptr);
+
+    QueryPerformanceFrequency (&freq_);
+
+    // Waiting this long is worth one priority class
+    aging_ticks_ = freq_.QuadPart * AGING_MS / 1000LL;
+
+    // Two jobs per thread keeps every stage busy, more only holds memory
+    create_.init (this, shutdown_, TSFix_CreateTexture, nullptr,  creators, creators * 2, false);
+    decode_.init (this, shutdown_, TSFix_DecodeStage,   &create_, decoders, decoders * 2, true);
+
+    SK_TextureWorkerThread::num_threads = io_workers;
+
+    for (int i = 0; i < io_workers; i++)
+      workers_.push_back (new SK_TextureWorkerThread (this));
+  }
+
+  void postJob (tsf_tex_load_s* job)
+  {
+    // Don't let the game free this while we are working on it...
+    job->pDest->AddRef ();
+
+    QueryPerformanceCounter_Original (&job->queued);
+
+    SK_TextureWorkerThread* pWorker =
+      workers_ [InterlockedIncrement (&next_worker_) % workers_.size ()];
+
+    job->worker = pWorker;
+    job->stage  = tsf_tex_load_s::Queued;
+
+    // Counted first, so that nobody skips a worker with posted jobs
+    InterlockedIncrement (&pWorker->queued_);
+    InterlockedIncrement (&stats_ [job->priority].depth);
+
+    pWorker->inbox_.push (job);
+
+    ReleaseSemaphore (work_available_, 1, nullptr);
+  }
+
+  //
+  // Takes a job that no worker has started out of its queue, so that the
+  //   caller can run it; false if it is running or finished already.
+  //
+  bool claimJob (tsf_tex_load_s* job)
+  {
+    SK_TextureWorkerThread* pWorker = job->worker;
+
+    if (pWorker == nullptr)
+      return false;
+
+    bool claimed = false;
+
+    EnterCriticalSection (&pWorker->cs_queue);
+    {
+      pWorker->drainInbox ();
+
+      if ( job->stage == tsf_tex_load_s::Queued &&
+           pWorker->queues_ [job->priority].remove (job) ) {
+        InterlockedDecrement (&pWorker->queued_);
+
+        job->worker = nullptr;
+        job->stage  = tsf_tex_load_s::Running;
+
+        claimed = true;
+      }
+    }
+    LeaveCriticalSection (&pWorker->cs_queue);
+
+    if (claimed)
+      InterlockedDecrement (&stats_ [job->priority].depth);
+
+    return claimed;
+  }
+
+  //
+  // Takes every queued job whose texture died out of the queues, straight to
+  //   completion; render thread only (it owns finished jobs).
+  //
+  void cancelDead (void)
+  {
+    if (queueLength () == 0)
+      return;
+
+    for (auto it : workers_) {
+      if (it->queued_ == 0)
+        continue;
+
+      EnterCriticalSection (&it->cs_queue);
+      {
+        it->drainInbox ();
+
+        for (int cls = 0; cls < PriorityCount; cls++) {
+          SK_LoadList& queue = it->queues_ [cls];
+          SK_LoadList  alive;
+
+          while (! queue.empty ()) {
+            tsf_tex_load_s* job = queue.pop_front ();
+
+            if (TSFix_LoadCancelled (job)) {
+              job->worker = nullptr;
+              job->stage  = tsf_tex_load_s::Finished;
+
+              postFinished (job);
+
+              InterlockedDecrement (&it->queued_);
+              InterlockedDecrement (&stats_ [cls].depth);
+            }
+
+            else
+              alive.push_back (job);
+          }
+
+          queue = alive;
+        }
+      }
+      LeaveCriticalSection (&it->cs_queue);
+    }
+  }
+
+  // Moves a queued job to the front of a more urgent class
+  void promote (tsf_tex_load_s* job, tsf_tex_priority_t priority)
+  {
+    SK_TextureWorkerThread* pWorker = job->worker;
+
+    if (pWorker == nullptr || job->priority <= priority)
+      return;
+
+    tsf_tex_priority_t from     = job->priority;
+    bool               promoted = false;
+
+    EnterCriticalSection (&pWorker->cs_queue);
+    {
+      pWorker->drainInbox ();
+
+      if ( job->stage == tsf_tex_load_s::Queued &&
+           pWorker->queues_ [from].remove (job) ) {
+        job->priority = priority;
+        pWorker->queues_ [priority].push_front (job);
+
+        promoted = true;
+      }
+    }
+    LeaveCriticalSection (&pWorker->cs_queue);
+
+    if (promoted) {
+      InterlockedDecrement (&stats_ [from].depth);
+      InterlockedIncrement (&stats_ [priority].depth);
+    }
+  }
+
+  // Runs every stage of a claimed job on the calling (render) thread
+  void runJob (tsf_tex_load_s* job);
+
+  // Someone is blocked on this job; put it first in whichever stage has it
+  void hurry (tsf_tex_load_s* job)
+  {
+    if (! decode_.hurry (job))
+          create_.hurry (job);
+  }
+
+  // Render thread only: appends finished jobs to out, in the order they finished
+  void getFinished (SK_LoadList& out)
+  {
+    results_.drain (out);
+  }
+
+  bool working (void) {
+    return (! results_.empty ());
+  }
+
+  int queueLength (void) {
+    int num = 0;
+
+    for (int i = 0; i < PriorityCount; i++)
+      num += stats_ [i].depth;
+
+    return num;
+  }
+
+  LONG depth (int priority) {
+    return stats_ [priority].depth;
+  }
+
+  bool used (int priority) {
+    return stats_ [priority].started > 0;
+  }
+
+  // Average time jobs of this class spent queued, since the last call
+  double waitMs (int priority)
+  {
+    LONG    count = InterlockedExchange   (&stats_ [priority].sampled,    0L);
+    LONG64  ticks = InterlockedExchange64 (&stats_ [priority].wait_ticks, 0LL);
+
+    if (count > 0) {
+      stats_ [priority].last_wait_ms =
+        1000.0 * (double)ticks / (double)count / (double)freq_.QuadPart;
+    }
+
+    return stats_ [priority].last_wait_ms;
+  }
+
+  LONG stageDepth (int stage)
+  {
+    return stage == StageIO     ? queueLength    () :
+           stage == StageDecode ? decode_.depth  () :
+                                  create_.depth  ();
+  }
+
+  int stageThreads (int stage)
+  {
+    return stage == StageIO     ? (int)workers_.size () :
+           stage == StageDecode ? decode_.threads     () :
+                                  create_.threads     ();
+  }
+
+  LONG folderBatches (void) const { return folder_batches_; }
+  LONG folderMates   (void) const { return folder_mates_;   }
+
+  // Hands the render thread a reduced copy of a job that is still running
+  void postPreview (tsf_tex_load_s* job, tsf_tex_load_s* preview);
+
+  SK_TextureStageStats& stageStats (int stage)
+  {
+    return stage == StageIO     ? io_stats_     :
+           stage == StageDecode ? decode_.stats :
+                                  create_.stats;
+  }
+
+  void shutdown (void) {
+    SetEvent (shutdown_);
+  }
+
+protected:
+  static const LONGLONG AGING_MS = 250LL;
+
+  void beginJob  (tsf_tex_load_s* job);
+
+  // Reads for archived jobs are issued by whichever worker is not busy
+  void readArchived (SK_TextureArchive* pArc);
+
+  //
+  // Takes the queued jobs for the same solid folder as job along with it;
+  //   true if the caller has to issue the archive's reads.
+  //
+  bool gatherFolder (tsf_tex_load_s* job, SK_TextureArchive* pArc);
+
+  // Queued jobs for the same solid folder as job, without taking them
+  size_t folderQueued (tsf_tex_load_s* job);
+
+  uint64_t folderKey (tsf_tex_load_s* job)
+  {
+    if (job->folder_key == 0ULL)
+      job->folder_key = job->user_font ? std::numeric_limits <uint64_t>::max () :
+                                         TSFix_FolderKey (job->checksum);
+
+    return job->folder_key;
+  }
+
+  // Passes a job that is done with a stage on to the next one, if any
+  void advance   (tsf_tex_load_s* job, HRESULT hr, SK_TexturePipelineStage* next);
+  void finishJob (tsf_tex_load_s* job, HRESULT hr);
+
+  //
+  // Most urgent job, stealing it from another worker if that one has it.
+  //   Higher classes age into Visible at most; only Blocking is Blocking.
+  //
+  //   The caller consumed a count of work_available_ for a job, so losing a
+  //     race for one only means looking again; nullptr once nothing is queued.
+  //
+  tsf_tex_load_s* takeJob (void)
+  {
+    for (;;) {
+      LARGE_INTEGER now;
+      QueryPerformanceCounter_Original (&now);
+
+      SK_TextureWorkerThread* pBest    = nullptr;
+      tsf_tex_load_s*         pJob     = nullptr;
+      int                     best_cls = PriorityCount;
+      LONGLONG                best_eff = std::numeric_limits <LONGLONG>::max ();
+
+      for (auto it : workers_) {
+        if (it->queued_ == 0)
+          continue;
+
+        EnterCriticalSection (&it->cs_queue);
+        {
+          it->drainInbox ();
+
+          for (int cls = 0; cls < PriorityCount; cls++) {
+            if (it->queues_ [cls].empty ())
+              continue;
+
+            // Oldest of its class, so the most aged
+            tsf_tex_load_s* front = it->queues_ [cls].front ();
+
+            LONGLONG eff =
+              effectivePriority (cls, now.QuadPart - front->queued.QuadPart);
+
+            if ( eff < best_eff ||
+                (eff == best_eff && front->queued.QuadPart < pJob->queued.QuadPart) ) {
+              pBest    = it;
+              pJob     = front;
+              best_cls = cls;
+              best_eff = eff;
+            }
+          }
+        }
+        LeaveCriticalSection (&it->cs_queue);
+      }
+
+      if (pJob == nullptr)
+        return nullptr;
+
+      bool taken = false;
+
+      EnterCriticalSection (&pBest->cs_queue);
+      {
+        SK_LoadList& queue =
+          pBest->queues_ [best_cls];
+
+        if (queue.front () == pJob) {
+          queue.pop_front ();
+          InterlockedDecrement (&pBest->queued_);
+
+          pJob->worker = nullptr;
+          pJob->stage  = tsf_tex_load_s::Running;
+
+          taken = true;
+        }
+      }
+      LeaveCriticalSection (&pBest->cs_queue);
+
+      // Someone else took it first
+      if (! taken)
+        continue;
+
+      InterlockedDecrement   (&stats_ [best_cls].depth);
+      InterlockedIncrement   (&stats_ [best_cls].started);
+      InterlockedIncrement   (&stats_ [best_cls].sampled);
+      InterlockedExchangeAdd64 ( &stats_ [best_cls].wait_ticks,
+                                   now.QuadPart - pJob->queued.QuadPart );
+
+      return pJob;
+    }
+  }
+
+  LONGLONG effectivePriority (int cls, LONGLONG waited) const
+  {
+    if (cls == PriorityBlocking)
+      return PriorityBlocking;
+
+    LONGLONG aged =
+      cls - (aging_ticks_ > 0 ? waited / aging_ticks_ : 0LL);
+
+    return std::max ((LONGLONG)PriorityVisible, aged);
+  }
+
+  void postFinished (tsf_tex_load_s* finished)
+  {
+    // The temporary reference we added earlier is held until the render
+    //   thread completes this load, which may be several frames from now.
+    results_.push (finished);
+  }
+
+private:
+  std::vector <SK_TextureWorkerThread *> workers_;
+  volatile LONG                          next_worker_ = 0L;
+
+  SK_LoadQueue                           results_;
+
+  HANDLE                                 work_available_ = nullptr;
+  HANDLE                                 shutdown_       = nullptr;
+
+  LARGE_INTEGER                          freq_        = { 0LL };
+  LONGLONG                               aging_ticks_ = 0LL;
+
+  SK_TextureStageStats                   io_stats_;
+  SK_TexturePipelineStage                decode_;
+  SK_TexturePipelineStage                create_;
+
+  volatile LONG                          folder_batches_ = 0L; // Folders decoded for more than one job
+  volatile LONG                          folder_mates_   = 0L; // Jobs that rode along
+
+  struct {
+    volatile LONG   depth        = 0L;
+    volatile LONG   started      = 0L;
+    volatile LONG   sampled      = 0L;
+    volatile LONG64 wait_ticks   = 0LL;
+    double          last_wait_ms = 0.0;
+  } stats_ [PriorityCount];
+} stream_pool;
+
+
+std::queue <TexLoadRef> textures_to_resample;
+
+//
+// Loads in-flight, by checksum. A request for a texture that is in-flight
+//   already attaches itself to that load (one CAS onto its waiter list)
+//     instead of starting another one, and receives the same override.
+//
+//   Keys are claimed once and never removed, so the table only has to have
+//     room for every checksum that can be streamed; it is sized in Init.
+//
+class SK_InFlightTable {
+public:
+  void init (size_t streamable)
+  {
+    size_t capacity = 64;
+
+    while (capacity < streamable * 2)
+      capacity <<= 1;
+
+    slots_ = new slot_s [capacity];
+    mask_  = capacity - 1;
+  }
+
+  void shutdown (void)
+  {
+    for (auto it : retired_)
+      load_pool.free (it);
+
+    retired_.clear ();
+
+    delete [] slots_;
+    slots_ = nullptr;
+  }
+
+  //
+  // True if load is now the one in-flight for its checksum; otherwise pSKTex
+  //   (if not nullptr) has been attached to the load that already was.
+  //
+  bool acquire (tsf_tex_load_s* load, ISKTextureD3D9* pSKTex)
+  {
+    slot_s* slot = find (load->checksum, true);
+
+    // Should never happen, but then the load simply is not tracked
+    if (slot == nullptr)
+      return true;
+
+    for (;;) {
+      if ( InterlockedCompareExchangePointer ( (PVOID volatile *)&slot->load,
+                                                 load,
+                                                   nullptr ) == nullptr )
+        return true;
+
+      if (pSKTex == nullptr)
+        return false;
+
+      if (attach (slot, pSKTex))
+        return false;
+
+      // The load finished while we were attaching, try again
+    }
+  }
+
+  bool contains (uint32_t checksum)
+  {
+    slot_s* slot = find (checksum, false);
+
+    return slot != nullptr && slot->load != nullptr;
+  }
+
+  // Render thread only, the load cannot be recycled until it completes there
+  tsf_tex_load_s* peek (uint32_t checksum)
+  {
+    slot_s* slot = find (checksum, false);
+
+    return slot != nullptr ? slot->load : nullptr;
+  }
+
+  //
+  // Render thread only: takes load out of the table and closes its waiter
+  //   list, returning everything that attached itself to it.
+  //
+  ISKTextureD3D9* finish (tsf_tex_load_s* load)
+  {
+    slot_s* slot = find (load->checksum, false);
+
+    if (slot != nullptr) {
+      InterlockedCompareExchangePointer ( (PVOID volatile *)&slot->load,
+                                            nullptr,
+                                              load );
+    }
+
+    ISKTextureD3D9* waiters =
+      (ISKTextureD3D9 *)InterlockedExchangePointer ( (PVOID volatile *)&load->waiters,
+                                                       closed () );
+
+    return waiters;
+  }
+
+  // An attach (...) may still be looking at a finished load, so it is not
+  //   recycled until nobody is.
+  void retire (tsf_tex_load_s* load)
+  {
+    retired_.push_back (load);
+  }
+
+  void collect (void)
+  {
+    if (retired_.empty () || readers_ != 0)
+      return;
+
+    for (auto it : retired_)
+      load_pool.free (it);
+
+    retired_.clear ();
+  }
+
+protected:
+  struct slot_s {
+    volatile LONG            key  = 0L;
+    tsf_tex_load_s* volatile load = nullptr;
+  };
+
+  static ISKTextureD3D9* closed (void) {
+    return reinterpret_cast <ISKTextureD3D9 *> (~(uintptr_t)0);
+  }
+
+  slot_s* find (uint32_t checksum, bool claim)
+  {
+    // 0 marks an empty slot, so it gets one of its own
+    if (checksum == 0x00)
+      return &zero_;
+
+    if (slots_ == nullptr)
+      return nullptr;
+
+    size_t idx = checksum & mask_;
+
+    for (size_t probe = 0; probe <= mask_; ++probe, idx = (idx + 1) & mask_) {
+      LONG key = slots_ [idx].key;
+
+      if (key == (LONG)checksum)
+        return &slots_ [idx];
+
+      if (key == 0L) {
+        if (! claim)
+          return nullptr;
+
+        key = InterlockedCompareExchange (&slots_ [idx].key, (LONG)checksum, 0L);
+
+        if (key == 0L || key == (LONG)checksum)
+          return &slots_ [idx];
+      }
+    }
+
+    return nullptr;
+  }
+
+  bool attach (slot_s* slot, ISKTextureD3D9* pSKTex)
+  {
+    bool attached = false;
+
+    InterlockedIncrement (&readers_);
+
+    tsf_tex_load_s* load = slot->load;
+
+    if (load != nullptr) {
+      // Held until the load completes, like the stream pool's reference
+      pSKTex->AddRef ();
+
+      ISKTextureD3D9* head = load->waiters;
+
+      while (head != closed ()) {
+        pSKTex->next_waiter = head;
+
+        ISKTextureD3D9* prev =
+          (ISKTextureD3D9 *)InterlockedCompareExchangePointer ( (PVOID volatile *)&load->waiters,
+                                                                  pSKTex,
+                                                                    head );
+
+        if (prev == head) {
+          attached = true;
+          break;
+        }
+
+        head = prev;
+      }
+
+      if (! attached) {
+        pSKTex->next_waiter = nullptr;
+        pSKTex->Release ();
+      }
+    }
+
+    InterlockedDecrement (&readers_);
+
+    return attached;
+  }
+
+private:
+  slot_s*                        slots_   = nullptr;
+  size_t                         mask_    = 0;
+  slot_s                         zero_;
+
+  volatile LONG                  readers_ = 0L;
+  std::vector <tsf_tex_load_s *> retired_;
+} in_flight;
+
+CRITICAL_SECTION              cs_tex_resample;
+CRITICAL_SECTION              cs_tex_inject;
 
 #define D3DX_DEFAULT            ((UINT) -1)
 #define D3DX_DEFAULT_NONPOW2    ((UINT) -2)
@@ -1493,344 +2720,3299 @@ CRITICAL_SECTION              cs_tex_inject;
 #define D3DX_FROM_FILE          ((UINT) -3)
 #define D3DFMT_FROM_FILE        ((D3DFORMAT) -3)
 
-std::set <DWORD> inject_tids;
+// Set while a worker is injecting, so that the D3DX calls it makes are not
+//   mistaken for the game's own.
+thread_local bool injecting = false;
+
+ LONG streaming       = 0;
+ULONG streaming_bytes = 0UL;
+
+int resampling = 0;
+
+// Finished loads that did not fit into the completion budget of the frame
+//   they finished on (render thread only).
+SK_LoadList finished_loads;
+SK_LoadList staged_uploads; // Finished, waiting for the render thread to upload them
+
+bool pending_restores   (void);
+void TSFix_ServeWaiters (ISKTextureD3D9* pSKTex, ISKTextureD3D9* waiters, bool loaded);
+
+bool
+pending_loads (void)
+{
+  return stream_pool.working () || (! finished_loads.empty ()) ||
+         (! staged_uploads.empty ()) || pending_restores ();
+}
+
+void
+start_load (void)
+{
+  injecting = true;
+}
+
+void
+end_load (void)
+{
+  injecting = false;
+}
+
+bool
+pending_streams (void)
+{
+  bool ret = false;
+
+  if (streaming || stream_pool.queueLength ())
+    ret = true;
+
+  return ret;
+}
+
+bool
+is_streaming (uint32_t checksum)
+{
+  return in_flight.contains (checksum);
+}
+
+// Keep a pool of memory around so that we are not allocating and freeing
+//  memory constantly... blocks travel with their load from stage to stage,
+//    so they are shared by every thread rather than kept per-thread.
+namespace streaming_memory {
+  struct block_s {
+    void*    data;
+    size_t   len;
+    uint32_t age;
+  };
+
+  const size_t MIN_LEN = 1024 * 1024;
+
+  std::vector        <block_s>        idle;
+  std::unordered_map <void*, size_t>  used;      // Length of blocks handed out
+  size_t                              idle_bytes = 0;
+  CRITICAL_SECTION                    cs_memory;
+
+  void init (void)
+  {
+    InitializeCriticalSectionAndSpinCount (&cs_memory, 1000UL);
+  }
+
+  // At least len bytes, nullptr if out of memory; give it back with release
+  void* alloc (size_t len)
+  {
+    void* data = nullptr;
+
+    EnterCriticalSection (&cs_memory);
+    {
+      // Smallest idle block that fits, as long as most of it gets used
+      auto best = idle.end ();
+
+      for (auto it = idle.begin (); it != idle.end (); ++it) {
+        if (it->len < len || it->len / 2 > std::max (len, MIN_LEN))
+          continue;
+
+        if (best == idle.end () || it->len < best->len)
+          best = it;
+      }
+
+      if (best != idle.end ()) {
+        data        = best->data;
+        used [data] = best->len;
+        idle_bytes -= best->len;
+
+        idle.erase (best);
+      }
+    }
+    LeaveCriticalSection (&cs_memory);
+
+    if (data == nullptr) {
+      size_t block_len = std::max (len, MIN_LEN);
+
+      data = malloc (block_len);
+
+      if (data != nullptr) {
+        EnterCriticalSection (&cs_memory);
+        {
+          used [data] = block_len;
+        }
+        LeaveCriticalSection (&cs_memory);
+      }
+    }
+
+    return data;
+  }
+
+  void release (void* data)
+  {
+    if (data == nullptr)
+      return;
+
+    EnterCriticalSection (&cs_memory);
+    {
+      auto it = used.find (data);
+
+      if (it != used.end ()) {
+        idle.push_back ({ data, it->second, timeGetTime () });
+        idle_bytes += it->second;
+
+        used.erase (it);
+      }
+    }
+    LeaveCriticalSection (&cs_memory);
+  }
+
+  // Frees blocks idle since before min_age until at most max_size are left
+  //   idle; returns how much was freed.
+  size_t trim (size_t max_size, uint32_t min_age)
+  {
+    size_t freed = 0;
+
+    EnterCriticalSection (&cs_memory);
+    {
+      for (auto it = idle.begin (); it != idle.end () && idle_bytes > max_size; ) {
+        if (it->age < min_age) {
+          free (it->data);
+
+          idle_bytes -= it->len;
+          freed      += it->len;
+
+          it = idle.erase (it);
+        }
+
+        else
+          ++it;
+      }
+    }
+    LeaveCriticalSection (&cs_memory);
+
+    return freed;
+  }
+}
+
+//
+// An injection archive, parsed once in Init and kept open. The I/O stage
+//   reads a folder's packed data with one positioned read (no shared file
+//     pointer to fight over), the decode stage decompresses it from memory.
+//
+//   Reads queue up while the archive is busy and are issued in file offset
+//     order, sweeping up and starting over at the lowest offset (C-SCAN);
+//       requests for the same folder, or close enough to each other, are
+//         merged into a single read. Only Blocking jobs jump the sweep.
+//
+class SK_TextureArchive {
+public:
+  struct read_s {
+    tsf_tex_load_s* load;
+    UInt64          start;
+    UInt64          end;
+  };
+
+  SK_TextureArchive (const wchar_t* wszName, const CSzArEx& arc)
+  {
+    name_ = wszName;
+    arc_  = arc; // Takes over everything it points to
+
+    InitializeCriticalSectionAndSpinCount (&cs_reads, 1000UL);
+
+    drained_ =
+      CreateEvent (nullptr, FALSE, FALSE, nullptr);
+
+    file_ =
+      CreateFileW ( wszName,
+                      GENERIC_READ,
+                        FILE_SHARE_READ,
+                          nullptr,
+                            OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL,
+                                nullptr );
+  }
+
+  ~SK_TextureArchive (void)
+  {
+    ISzAlloc alloc = { SzAlloc, SzFree };
+
+    if (file_ != INVALID_HANDLE_VALUE)
+      CloseHandle (file_);
+
+    CloseHandle           (drained_);
+    DeleteCriticalSection (&cs_reads);
+
+    SzArEx_Free (&arc_, &alloc);
+  }
+
+  bool           valid (void) const { return file_ != INVALID_HANDLE_VALUE; }
+  const wchar_t* name  (void) const { return name_.c_str ();                }
+
+  UInt32 folderOf (int fileno) const {
+    return arc_.FileToFolder [fileno];
+  }
+
+  // Compressed data of a folder, as offsets into the archive file
+  UInt64 packStart (UInt32 folder) const {
+    return arc_.dataPos + arc_.db.PackPositions [arc_.db.FoStartPackStreamIndex [folder]];
+  }
+
+  UInt64 packEnd (UInt32 folder) const {
+    return arc_.dataPos + arc_.db.PackPositions [arc_.db.FoStartPackStreamIndex [folder + 1]];
+  }
+
+  size_t unpackSize (UInt32 folder) const {
+    return (size_t)SzAr_GetFolderUnpackSize (&arc_.db, folder);
+  }
+
+  UInt32 folderFiles (UInt32 folder) const {
+    return arc_.FolderToFile [folder + 1] - arc_.FolderToFile [folder];
+  }
+
+  // Where a file starts in its decompressed folder
+  size_t fileOffset (int fileno) const {
+    return (size_t)( arc_.UnpackPositions [fileno] -
+                       arc_.UnpackPositions [arc_.FolderToFile [folderOf (fileno)]] );
+  }
+
+  size_t fileSize (int fileno) const {
+    return (size_t)SzArEx_GetFileSize (&arc_, fileno);
+  }
+
+  //
+  // Queues the read of an archived load's folder; true if the caller has to
+  //   issue the queued reads (nextRead) because nobody else is.
+  //
+  bool submit (tsf_tex_load_s* load)
+  {
+    const UInt32 folder = folderOf (load->record->fileno);
+
+    read_s read = { load, packStart (folder), packEnd (folder) };
+
+    bool service = false;
+
+    EnterCriticalSection (&cs_reads);
+    {
+      auto pos =
+        std::upper_bound ( pending_.begin (), pending_.end (), read,
+                             [](const read_s& a, const read_s& b) {
+                               return a.start < b.start;
+                             } );
+
+      pending_.insert (pos, read);
+
+      // What issuing reads in the order they were requested would cost
+      seek_fifo_  += distance (arrival_, read.start);
+      arrival_     = read.end;
+
+      ++requests_;
+
+      if (! servicing_)
+        service = servicing_ = true;
+    }
+    LeaveCriticalSection (&cs_reads);
+
+    return service;
+  }
+
+  //
+  // Takes the next read off the queue, merged with any that follow it
+  //   closely; false (and the caller stops servicing) once it is empty.
+  //
+  bool nextRead (std::vector <read_s>& batch, UInt64* pStart, size_t* pLen)
+  {
+    batch.clear ();
+
+    EnterCriticalSection (&cs_reads);
+
+    if (pending_.empty ()) {
+      servicing_ = false;
+
+      LeaveCriticalSection (&cs_reads);
+      SetEvent             (drained_);
+
+      return false;
+    }
+
+    size_t first = pending_.size ();
+
+    // Blocking first, lowest offset among them
+    for (size_t i = 0; i < pending_.size (); i++) {
+      if (pending_ [i].load->priority == PriorityBlocking) {
+        first = i;
+        break;
+      }
+    }
+
+    // Next one up from the head, or start over at the bottom
+    if (first == pending_.size ()) {
+      first = 0;
+
+      for (size_t i = 0; i < pending_.size (); i++) {
+        if (pending_ [i].start >= head_) {
+          first = i;
+          break;
+        }
+      }
+    }
+
+    UInt64 start = pending_ [first].start;
+    UInt64 end   = pending_ [first].end;
+    size_t last  = first + 1;
+
+    // Loading screens can afford to read through more
+    const UInt64 gap =
+      load_phase.loading () ? MERGE_GAP * 4ULL : MERGE_GAP;
+
+    while ( last < pending_.size ()                        &&
+            pending_ [last].start <= end + gap              &&
+            pending_ [last].end   -  start <= MAX_MERGE_LEN ) {
+      end = std::max (end, pending_ [last].end);
+      ++last;
+    }
+
+    batch.assign (pending_.begin () + first, pending_.begin () + last);
+    pending_.erase (pending_.begin () + first, pending_.begin () + last);
+
+    seek_  += distance (head_, start);
+    head_   = end;
+
+    ++reads_;
+    merged_ += batch.size () - 1;
+
+    LeaveCriticalSection (&cs_reads);
+
+    SetEvent (drained_);
+
+    *pStart = start;
+    *pLen   = (size_t)(end - start);
+
+    return true;
+  }
+
+  // Keeps workers from queuing up more than a sweep's worth of reads
+  void waitForRoom (void)
+  {
+    while (pending () >= MAX_PENDING)
+      WaitForSingleObject (drained_, 10UL);
+  }
+
+  size_t pending (void)
+  {
+    size_t count = 0;
+
+    EnterCriticalSection (&cs_reads);
+    {
+      count = pending_.size ();
+    }
+    LeaveCriticalSection (&cs_reads);
+
+    return count;
+  }
+
+  //
+  // Someone is blocked on this load; it jumps the sweep of whichever archive
+  //   has its read queued. Searches them all, rather than trusting the job's
+  //     source and record, which the I/O stage may be writing right now.
+  //
+  static void hurry (tsf_tex_load_s* load);
+
+  ULONG  requests (void) const { return requests_; }
+  ULONG  reads    (void) const { return reads_;    }
+  ULONG  merged   (void) const { return merged_;   }
+
+  // Total distance between the end of one read and the start of the next
+  UInt64 seekBytes     (void) const { return seek_;      }
+  UInt64 seekBytesFIFO (void) const { return seek_fifo_; }
+
+  bool read (UInt64 offset, void* pDest, size_t len)
+  {
+    OVERLAPPED ov = { };
+
+    ov.Offset     = (DWORD)(offset & 0xFFFFFFFFULL);
+    ov.OffsetHigh = (DWORD)(offset >> 32ULL);
+
+    DWORD dwRead = 0UL;
+
+    return ReadFile (file_, pDest, (DWORD)len, &dwRead, &ov) && dwRead == len;
+  }
+
+  // pPacked holds the folder's compressed data, read from packStart (...)
+  bool decode ( UInt32      folder,
+                const void* pPacked, size_t packed_len,
+                void*       pOut,    size_t out_len )
+  {
+    mem_stream_s stream;
+
+    stream.s.Look = Look;
+    stream.s.Skip = Skip;
+    stream.s.Read = Read;
+    stream.s.Seek = Seek;
+
+    stream.data   = (const Byte *)pPacked;
+    stream.size   = packed_len;
+    stream.pos    = 0;
+    stream.base   = packStart (folder);
+
+    ISzAlloc alloc = { SzAlloc, SzFree };
+
+    return SzAr_DecodeFolder ( &arc_.db, folder,
+                                 &stream.s, arc_.dataPos,
+                                   (Byte *)pOut, out_len,
+                                     &alloc ) == SZ_OK;
+  }
+
+  bool verify (int fileno, const void* pData) const
+  {
+    if (! SzBitWithVals_Check (&arc_.CRCs, fileno))
+      return true;
+
+    return CrcCalc (pData, fileSize (fileno)) == arc_.CRCs.Vals [fileno];
+  }
+
+protected:
+  // Seeks are in archive file offsets, data [0] is at base
+  struct mem_stream_s {
+    ILookInStream s;
+    const Byte*   data;
+    size_t        size;
+    size_t        pos;
+    UInt64        base;
+  };
+
+  static SRes Look (void* p, const void** buf, size_t* size)
+  {
+    mem_stream_s* stream = (mem_stream_s *)p;
+
+    *size = std::min (*size, stream->size - stream->pos);
+    *buf  = stream->data + stream->pos;
+
+    return SZ_OK;
+  }
+
+  static SRes Skip (void* p, size_t offset)
+  {
+    mem_stream_s* stream = (mem_stream_s *)p;
+
+    stream->pos = std::min (stream->size, stream->pos + offset);
+
+    return SZ_OK;
+  }
+
+  static SRes Read (void* p, void* buf, size_t* size)
+  {
+    const void* src = nullptr;
+
+    Look (p, &src, size);
+    memcpy (buf, src, *size);
+
+    return Skip (p, *size);
+  }
+
+  static SRes Seek (void* p, Int64* pos, ESzSeek origin)
+  {
+    mem_stream_s* stream = (mem_stream_s *)p;
+
+    Int64 to = *pos;
+
+    if      (origin == SZ_SEEK_SET) to -= (Int64)stream->base;
+    else if (origin == SZ_SEEK_CUR) to += (Int64)stream->pos;
+    else                            to += (Int64)stream->size;
+
+    if (to < 0 || to > (Int64)stream->size)
+      return SZ_ERROR_READ;
+
+    stream->pos = (size_t)to;
+    *pos        = (Int64)stream->base + to;
+
+    return SZ_OK;
+  }
+
+  static UInt64 distance (UInt64 from, UInt64 to) {
+    return from > to ? from - to : to - from;
+  }
+
+private:
+  static const UInt64 MERGE_GAP     = 256ULL * 1024ULL;        // Cheaper to read through than to seek
+  static const UInt64 MAX_MERGE_LEN = 32ULL  * 1024ULL * 1024ULL;
+  static const size_t MAX_PENDING   = 32;
+
+  std::wstring         name_;
+  CSzArEx              arc_;
+  HANDLE               file_ = INVALID_HANDLE_VALUE;
+
+  CRITICAL_SECTION     cs_reads;
+  std::vector <read_s> pending_;                // By offset
+  bool                 servicing_ = false;
+  HANDLE               drained_   = nullptr;
+
+  UInt64               head_      = 0ULL;       // End of the last read
+  UInt64               arrival_   = 0ULL;       // End of the last request
+  UInt64               seek_      = 0ULL;
+  UInt64               seek_fifo_ = 0ULL;
+  ULONG                requests_  = 0UL;
+  ULONG                reads_     = 0UL;
+  ULONG                merged_    = 0UL;
+};
+
+std::vector <SK_TextureArchive *> archive_dbs; // Same order as archives
+
+void
+SK_TextureArchive::hurry (tsf_tex_load_s* load)
+{
+  for (auto pArc : archive_dbs) {
+    bool found = false;
+
+    EnterCriticalSection (&pArc->cs_reads);
+    {
+      for (auto& it : pArc->pending_) {
+        if (it.load == load) {
+          load->priority = PriorityBlocking;
+          found          = true;
+        }
+      }
+    }
+    LeaveCriticalSection (&pArc->cs_reads);
+
+    if (found)
+      break;
+  }
+}
+
+// Identifies the solid folder an injectable texture is stored in; ~0 if
+//   it is not archived.
+uint64_t
+TSFix_FolderKey (uint32_t checksum)
+{
+  const tsf_tex_record_s* rec =
+    tex_policy.injectable (checksum);
+
+  if (rec == nullptr || rec->archive >= archive_dbs.size ())
+    return std::numeric_limits <uint64_t>::max ();
+
+  return ((uint64_t)(rec->archive + 1) << 32ULL) |
+           archive_dbs [rec->archive]->folderOf (rec->fileno);
+}
+
+//
+// System memory copies of injected textures, so that D3D9 Reset (and
+//   re-requests after a purge) can re-upload them with UpdateTexture (...)
+//     instead of going back to the archive and decompressing them again.
+//
+//   Bounded by ResetShadowCacheInMiB, least recently used are dropped first.
+//     Remember that these cost address space in a 32-bit process...
+//
+class SK_TextureShadowCache {
+public:
+  struct shadow_s {
+    IDirect3DTexture9* pTex;
+    size_t             size;
+    LONGLONG           last_used;
+  };
+
+  void init (void) {
+    InitializeCriticalSectionAndSpinCount (&cs_shadow, 1000UL);
+  }
+
+  void shutdown (void) {
+    clear                 ();
+    DeleteCriticalSection (&cs_shadow);
+  }
+
+  bool enabled (void) {
+    return config.textures.shadow_in_mib > 0;
+  }
+
+  // Takes ownership of one reference to pTex
+  void store (uint32_t checksum, IDirect3DTexture9* pTex, size_t size, LONGLONG last_used)
+  {
+    const int64_t budget =
+      (int64_t)config.textures.shadow_in_mib * 1024LL * 1024LL;
+
+    EnterCriticalSection (&cs_shadow);
+    {
+      auto existing = shadows_.find (checksum);
+
+      if (existing != shadows_.end ()) {
+        existing->second.last_used =
+          std::max (existing->second.last_used, last_used);
+
+        LeaveCriticalSection (&cs_shadow);
+
+        pTex->Release ();
+        return;
+      }
+
+      while (bytes_ + (int64_t)size > budget && (! shadows_.empty ())) {
+        auto lru = shadows_.begin ();
+
+        for (auto it = shadows_.begin (); it != shadows_.end (); ++it) {
+          if (it->second.last_used < lru->second.last_used)
+            lru = it;
+        }
+
+        bytes_ -= lru->second.size;
+        lru->second.pTex->Release ();
+
+        shadows_.erase (lru);
+      }
+
+      if (bytes_ + (int64_t)size <= budget) {
+        shadows_ [checksum] = { pTex, size, last_used };
+        bytes_             += size;
+        pTex                = nullptr;
+      }
+    }
+    LeaveCriticalSection (&cs_shadow);
+
+    // Larger than the entire budget
+    if (pTex != nullptr)
+      pTex->Release ();
+  }
+
+  void touch (uint32_t checksum, LONGLONG last_used)
+  {
+    EnterCriticalSection (&cs_shadow);
+    {
+      auto shadow = shadows_.find (checksum);
+
+      if (shadow != shadows_.end ())
+        shadow->second.last_used = std::max (shadow->second.last_used, last_used);
+    }
+    LeaveCriticalSection (&cs_shadow);
+  }
+
+  //
+  // Takes the place of a stream job if there is a shadow for this texture;
+  //   the upload happens on the render thread in restore (...).
+  //
+  bool requestRestore (tsf_tex_load_s* load)
+  {
+    if (! enabled ())
+      return false;
+
+    bool queued = false;
+
+    EnterCriticalSection (&cs_shadow);
+    {
+      auto shadow = shadows_.find (load->checksum);
+
+      if (shadow != shadows_.end ()) {
+        load->pShadow = shadow->second.pTex;
+        load->pShadow->AddRef ();
+
+        // Same temporary reference the stream pool would have added
+        load->pDest->AddRef ();
+
+        // Blocking textures first, then most recently used
+        LONGLONG priority =
+          ((ISKTextureD3D9 *)load->pDest)->must_block ?
+            std::numeric_limits <LONGLONG>::max () :
+              shadow->second.last_used;
+
+        restores_.push_back (std::make_pair (priority, load));
+
+        queued = true;
+      }
+    }
+    LeaveCriticalSection (&cs_shadow);
+
+    return queued;
+  }
+
+  //
+  // Uploads queued restores in priority order until budget_ticks elapse,
+  //   finished ones are appended to done.
+  //
+  void restore (LONGLONG budget_ticks, bool at_least_one, SK_LoadList& done)
+  {
+    std::vector <std::pair <LONGLONG, tsf_tex_load_s *>> queue;
+
+    EnterCriticalSection (&cs_shadow);
+    {
+      queue.swap (restores_);
+    }
+    LeaveCriticalSection (&cs_shadow);
+
+    if (queue.empty ())
+      return;
+
+    std::sort ( queue.begin (), queue.end (),
+      []( const std::pair <LONGLONG, tsf_tex_load_s *>& a,
+          const std::pair <LONGLONG, tsf_tex_load_s *>& b )
+    {
+      return a.first > b.first;
+    } );
+
+    LARGE_INTEGER start, now;
+    QueryPerformanceCounter_Original (&start);
+
+    now = start;
+
+    auto it = queue.begin ();
+
+    while ( it != queue.end () &&
+            ( (at_least_one && it == queue.begin ()) ||
+              now.QuadPart - start.QuadPart < budget_ticks ) ) {
+      tsf_tex_load_s* load = it->second;
+
+      QueryPerformanceFrequency        (&load->freq);
+      QueryPerformanceCounter_Original (&load->start);
+
+      D3DSURFACE_DESC desc;
+      load->pShadow->GetLevelDesc (0, &desc);
+
+      HRESULT hr =
+        D3D9CreateTexture_Original ( load->pDevice,
+                                       desc.Width, desc.Height,
+                                         load->pShadow->GetLevelCount (),
+                                           0x00, desc.Format,
+                                             D3DPOOL_DEFAULT,
+                                               &load->pSrc,
+                                                 nullptr );
+
+      if (SUCCEEDED (hr))
+        hr = load->pDevice->UpdateTexture (load->pShadow, load->pSrc);
+
+      if (FAILED (hr) && load->pSrc != nullptr) {
+        load->pSrc->Release ();
+        load->pSrc = nullptr;
+      }
+
+      QueryPerformanceCounter_Original (&load->end);
+
+      if (SUCCEEDED (hr)) {
+        ++restored_;
+        done.push_back (load);
+      }
+
+      // Fall back to streaming it the old-fashioned way
+      else {
+        tex_log->Log ( L"[ Tex. Mgr ] Shadow restore failed for %08x (hr=%x), "
+                       L"streaming instead",
+                         load->checksum, hr );
+
+        load->pShadow->Release ();
+        load->pShadow = nullptr;
+
+        extern void TSFix_RestreamTexture (tsf_tex_load_s* load);
+        TSFix_RestreamTexture (load);
+      }
+
+      ++it;
+
+      QueryPerformanceCounter_Original (&now);
+    }
+
+    // Anything left goes back to the front of the line
+    if (it != queue.end ()) {
+      EnterCriticalSection (&cs_shadow);
+      {
+        restores_.insert (restores_.end (), it, queue.end ());
+      }
+      LeaveCriticalSection (&cs_shadow);
+    }
+  }
+
+  bool pending (void) {
+    return (! restores_.empty ());
+  }
+
+  void clear (void)
+  {
+    EnterCriticalSection (&cs_shadow);
+    {
+      for (auto it : shadows_)
+        it.second.pTex->Release ();
+
+      shadows_.clear ();
+      bytes_ = 0LL;
+    }
+    LeaveCriticalSection (&cs_shadow);
+  }
+
+  size_t  count    (void) { return shadows_.size (); }
+  int64_t bytes    (void) { return bytes_;           }
+  ULONG   restored (void) { return restored_;        }
+
+private:
+  std::unordered_map <uint32_t, shadow_s>               shadows_;
+  std::vector <std::pair <LONGLONG, tsf_tex_load_s *>> restores_;
+
+  int64_t          bytes_    = 0LL;
+  ULONG            restored_ = 0UL;
+
+  CRITICAL_SECTION cs_shadow;
+} reset_shadows;
+
+//
+// Decompressed DDS data for injected textures, kept in RAM so that a texture
+//   evicted by purge (...) can be brought back without touching the disk or
+//     LZMA again. Data is captured when a texture is first loaded; entries
+//       whose override is still resident are the first to go when the budget
+//         (RAMCacheInMiB) runs out, since those are not needed yet.
+//
+class SK_TextureRAMCache {
+public:
+  struct entry_s {
+    uint8_t* data;
+    size_t   size;
+    DWORD    last_used;
+    bool     resident;   // Override is currently in VRAM
+    bool     prefetched; // Not requested since it was stored
+  };
+
+  void init (void) {
+    InitializeCriticalSectionAndSpinCount (&cs_ram, 1000UL);
+  }
+
+  void shutdown (void) {
+    clear                 ();
+    DeleteCriticalSection (&cs_ram);
+  }
+
+  bool enabled (void) {
+    return config.textures.ram_cache_in_mib > 0;
+  }
+
+  void store (uint32_t checksum, const void* data, size_t size, bool prefetched = false)
+  {
+    if (! enabled ())
+      return;
+
+    const int64_t budget =
+      (int64_t)config.textures.ram_cache_in_mib * 1024LL * 1024LL;
+
+    if ((int64_t)size > budget)
+      return;
+
+    uint8_t* copy = (uint8_t *)malloc (size);
+
+    if (copy == nullptr)
+      return;
+
+    memcpy (copy, data, size);
+
+    EnterCriticalSection (&cs_ram);
+    {
+      auto existing = entries_.find (checksum);
+
+      if (existing != entries_.end ()) {
+        bytes_ -= existing->second.size;
+        free (existing->second.data);
+        entries_.erase (existing);
+      }
+
+      while (bytes_ + (int64_t)size > budget && (! entries_.empty ())) {
+        auto victim = entries_.begin ();
+
+        for (auto it = entries_.begin (); it != entries_.end (); ++it) {
+          if (it->second.resident != victim->second.resident) {
+            if (it->second.resident)
+              victim = it;
+          }
+
+          else if (it->second.last_used < victim->second.last_used)
+            victim = it;
+        }
+
+        bytes_ -= victim->second.size;
+        free (victim->second.data);
+
+        entries_.erase (victim);
+      }
+
+      entries_ [checksum] = { copy, size, timeGetTime (), (! prefetched), prefetched };
+      bytes_             += size;
+    }
+    LeaveCriticalSection (&cs_ram);
+  }
+
+  //
+  // Copies the data into a streaming memory block (the caller releases it),
+  //   false on a miss.
+  //
+  bool fetch (uint32_t checksum, void** ppData, size_t* pSize);
+
+  bool contains (uint32_t checksum)
+  {
+    bool found = false;
+
+    EnterCriticalSection (&cs_ram);
+    {
+      found = entries_.count (checksum) != 0;
+    }
+    LeaveCriticalSection (&cs_ram);
+
+    return found;
+  }
+
+  // It did not survive being cached intact
+  void remove (uint32_t checksum)
+  {
+    if (! enabled ())
+      return;
+
+    EnterCriticalSection (&cs_ram);
+    {
+      auto entry = entries_.find (checksum);
+
+      if (entry != entries_.end ()) {
+        bytes_ -= entry->second.size;
+        free (entry->second.data);
+
+        entries_.erase (entry);
+      }
+    }
+    LeaveCriticalSection (&cs_ram);
+  }
+
+  // Fits without evicting anything
+  bool room (size_t size)
+  {
+    return bytes_ + (int64_t)size <=
+             (int64_t)config.textures.ram_cache_in_mib * 1024LL * 1024LL;
+  }
+
+  void setResident (uint32_t checksum, bool resident)
+  {
+    if (! enabled ())
+      return;
+
+    EnterCriticalSection (&cs_ram);
+    {
+      auto entry = entries_.find (checksum);
+
+      if (entry != entries_.end ())
+        entry->second.resident = resident;
+    }
+    LeaveCriticalSection (&cs_ram);
+  }
+
+  void clear (void)
+  {
+    EnterCriticalSection (&cs_ram);
+    {
+      for (auto it : entries_)
+        free (it.second.data);
+
+      entries_.clear ();
+      bytes_ = 0LL;
+    }
+    LeaveCriticalSection (&cs_ram);
+  }
+
+  size_t  count  (void) { return entries_.size (); }
+  int64_t bytes  (void) { return bytes_;           }
+  ULONG   hits   (void) { return hits_;            }
+  ULONG   misses (void) { return misses_;          }
+
+  ULONG   prefetchHits (void) { return prefetch_hits_; }
+
+private:
+  std::unordered_map <uint32_t, entry_s> entries_;
+
+  int64_t          bytes_         = 0LL;
+  ULONG            hits_          = 0UL;
+  ULONG            misses_        = 0UL;
+  ULONG            prefetch_hits_ = 0UL;
+
+  CRITICAL_SECTION cs_ram;
+} ram_cache;
+
+#define TSFIX_DISK_CACHE_DIR TSFIX_TEXTURE_DIR L"\\cache\\textures"
+
+//
+// Decompressed archive entries, stored as plain .dds files so that repeat
+//   loads are a sequential read instead of an LZMA decode (which is much
+//     slower than a fast SSD). Files are named <archive id>_<crc32>.dds.
+//
+//   Written asynchronously by a dedicated thread after the first decode,
+//     and trimmed least recently used first once DiskCacheInMiB is exceeded.
+//
+class SK_TextureDiskCache {
+public:
+  struct entry_s {
+    size_t   size;
+    uint64_t last_used; // FILETIME
+  };
+
+  struct write_s {
+    uint64_t key;
+    uint8_t* data;      // nullptr = only touch the file
+    size_t   size;
+  };
+
+  void init (void)
+  {
+    InitializeCriticalSectionAndSpinCount (&cs_disk, 1000UL);
+
+    if (! enabled ())
+      return;
+
+    CreateDirectoryW (TSFIX_TEXTURE_DIR,                 nullptr);
+    CreateDirectoryW (TSFIX_TEXTURE_DIR L"\\cache",      nullptr);
+    CreateDirectoryW (TSFIX_DISK_CACHE_DIR,               nullptr);
+
+    WIN32_FIND_DATA fd;
+    HANDLE          hFind =
+      FindFirstFileW (TSFIX_DISK_CACHE_DIR L"\\*.dds", &fd);
+
+    if (hFind != INVALID_HANDLE_VALUE) {
+      do {
+        uint32_t archive_id, checksum;
+
+        if (swscanf (fd.cFileName, L"%08x_%08x.dds", &archive_id, &checksum) != 2)
+          continue;
+
+        entry_s entry;
+        entry.size      = fd.nFileSizeLow;
+        entry.last_used = ((uint64_t)fd.ftLastWriteTime.dwHighDateTime << 32ULL) |
+                                     fd.ftLastWriteTime.dwLowDateTime;
+
+        entries_ [key (archive_id, checksum)] = entry;
+        bytes_                               += entry.size;
+      } while (FindNextFileW (hFind, &fd) != 0);
+
+      FindClose (hFind);
+    }
+
+    tex_log->Log ( L"[Disk Cache] %lu cached textures (%7.2f MiB)",
+                     entries_.size (),
+                       (double)bytes_ / (1024.0 * 1024.0) );
+
+    events_.work     = CreateEvent (nullptr, FALSE, FALSE, nullptr);
+    events_.shutdown = CreateEvent (nullptr, FALSE, FALSE, nullptr);
+
+    writer_thread_ =
+      (HANDLE)_beginthreadex ( nullptr,
+                                 0,
+                                   Writer,
+                                     this,
+                                       0x00,
+                                         nullptr );
+  }
+
+  void shutdown (void)
+  {
+    if (writer_thread_ != nullptr) {
+      SetEvent            (events_.shutdown);
+      WaitForSingleObject (writer_thread_, INFINITE);
+
+      CloseHandle (writer_thread_);
+      CloseHandle (events_.work);
+      CloseHandle (events_.shutdown);
+
+      writer_thread_ = nullptr;
+    }
+
+    for (auto it : writes_)
+      free (it.data);
+
+    writes_.clear ();
+
+    DeleteCriticalSection (&cs_disk);
+  }
+
+  bool enabled (void) {
+    return config.textures.disk_in_mib > 0;
+  }
+
+  // Reads a cached entry into a streaming memory block (the caller releases it)
+  bool fetch (uint32_t archive_id, uint32_t checksum, void** ppData, size_t* pSize)
+  {
+    if (writer_thread_ == nullptr)
+      return false;
+
+    uint64_t k     = key (archive_id, checksum);
+    bool     known = false;
+
+    EnterCriticalSection (&cs_disk);
+    {
+      known = entries_.count (k) != 0;
+    }
+    LeaveCriticalSection (&cs_disk);
+
+    bool hit     = false;
+    bool missing = true;
+
+    if (known) {
+      wchar_t wszFileName [MAX_PATH];
+      fileName (k, wszFileName);
+
+      HANDLE hFile =
+        CreateFileW ( wszFileName,
+                        GENERIC_READ,
+                          FILE_SHARE_READ,
+                            nullptr,
+                              OPEN_EXISTING,
+                                FILE_ATTRIBUTE_NORMAL |
+                                FILE_FLAG_SEQUENTIAL_SCAN,
+                                  nullptr );
+
+      if (hFile != INVALID_HANDLE_VALUE) {
+        DWORD size = GetFileSize (hFile, nullptr);
+        DWORD read = 0UL;
+
+        missing = false;
+
+        *ppData = streaming_memory::alloc (size);
+
+        if (*ppData != nullptr) {
+          hit = ReadFile (hFile, *ppData, size, &read, nullptr) && read == size;
+          *pSize = read;
+
+          if (! hit) {
+            streaming_memory::release (*ppData);
+            *ppData = nullptr;
+          }
+        }
+
+        CloseHandle (hFile);
+      }
+
+      EnterCriticalSection (&cs_disk);
+      {
+        auto entry = entries_.find (k);
+
+        if (entry != entries_.end ()) {
+          // Someone deleted it behind our back, forget about it
+          if (missing) {
+            bytes_ -= entry->second.size;
+            entries_.erase (entry);
+          }
+
+          else if (hit) {
+            FILETIME now;
+            GetSystemTimeAsFileTime (&now);
+
+            entry->second.last_used =
+              ((uint64_t)now.dwHighDateTime << 32ULL) | now.dwLowDateTime;
+
+            writes_.push_back ({ k, nullptr, 0 });
+            SetEvent          (events_.work);
+          }
+        }
+      }
+      LeaveCriticalSection (&cs_disk);
+    }
+
+    if (hit) InterlockedIncrement (&hits_);
+    else     InterlockedIncrement (&misses_);
+
+    return hit;
+  }
+
+  // Queues a copy of the data to be written by the writer thread
+  void store (uint32_t archive_id, uint32_t checksum, const void* data, size_t size)
+  {
+    if (writer_thread_ == nullptr)
+      return;
+
+    uint64_t k = key (archive_id, checksum);
+
+    EnterCriticalSection (&cs_disk);
+    {
+      if (entries_.count (k) || pending_.count (k)) {
+        LeaveCriticalSection (&cs_disk);
+        return;
+      }
+
+      pending_.insert (k);
+    }
+    LeaveCriticalSection (&cs_disk);
+
+    uint8_t* copy = (uint8_t *)malloc (size);
+
+    EnterCriticalSection (&cs_disk);
+    {
+      if (copy != nullptr) {
+        memcpy (copy, data, size);
+
+        writes_.push_back ({ k, copy, size });
+        SetEvent          (events_.work);
+      }
+
+      else
+        pending_.erase (k);
+    }
+    LeaveCriticalSection (&cs_disk);
+  }
+
+  // Deletes a cached file that D3DX could not make sense of
+  void remove (uint32_t archive_id, uint32_t checksum)
+  {
+    if (writer_thread_ == nullptr)
+      return;
+
+    uint64_t k = key (archive_id, checksum);
+
+    wchar_t wszFileName [MAX_PATH];
+    fileName (k, wszFileName);
+
+    EnterCriticalSection (&cs_disk);
+    {
+      auto entry = entries_.find (k);
+
+      if (entry != entries_.end ()) {
+        bytes_ -= entry->second.size;
+        entries_.erase (entry);
+      }
+
+      DeleteFileW (wszFileName);
+    }
+    LeaveCriticalSection (&cs_disk);
+
+    tex_log->Log ( L"[Disk Cache] Removed corrupt entry %s",
+                     wszFileName );
+  }
+
+  size_t  count  (void) { return entries_.size (); }
+  int64_t bytes  (void) { return bytes_;           }
+  ULONG   hits   (void) { return hits_;            }
+  ULONG   misses (void) { return misses_;          }
+
+protected:
+  static unsigned int __stdcall Writer (LPVOID user);
+
+  static uint64_t key (uint32_t archive_id, uint32_t checksum) {
+    return ((uint64_t)archive_id << 32ULL) | checksum;
+  }
+
+  static void fileName (uint64_t k, wchar_t* wszFileName) {
+    _swprintf ( wszFileName, L"%s\\%08x_%08x.dds",
+                  TSFIX_DISK_CACHE_DIR,
+                    (uint32_t)(k >> 32ULL),
+                      (uint32_t)(k & 0xffffffffULL) );
+  }
+
+  void write (write_s& job);
+  void trim  (void);
+
+private:
+  std::unordered_map <uint64_t, entry_s> entries_;
+  std::set           <uint64_t>          pending_;
+  std::vector        <write_s>           writes_;
+
+  int64_t          bytes_  = 0LL;
+  ULONG            hits_   = 0UL;
+  ULONG            misses_ = 0UL;
+
+  struct {
+    HANDLE work     = nullptr;
+    HANDLE shutdown = nullptr;
+  } events_;
+
+  HANDLE           writer_thread_ = nullptr;
+  CRITICAL_SECTION cs_disk;
+} disk_cache;
+
+void
+SK_TextureDiskCache::write (write_s& job)
+{
+  wchar_t wszFileName [MAX_PATH];
+  fileName (job.key, wszFileName);
+
+  FILETIME now;
+  GetSystemTimeAsFileTime (&now);
+
+  // Touch
+  if (job.data == nullptr) {
+    HANDLE hFile =
+      CreateFileW ( wszFileName,
+                      FILE_WRITE_ATTRIBUTES,
+                        FILE_SHARE_READ,
+                          nullptr,
+                            OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL,
+                                nullptr );
+
+    if (hFile != INVALID_HANDLE_VALUE) {
+      SetFileTime (hFile, nullptr, nullptr, &now);
+      CloseHandle (hFile);
+    }
+
+    return;
+  }
+
+  // Write to a temporary file first, a partially written texture must
+  //   never be mistaken for a complete one.
+  wchar_t wszTempName [MAX_PATH];
+  _swprintf (wszTempName, L"%s.tmp", wszFileName);
+
+  HANDLE hFile =
+    CreateFileW ( wszTempName,
+                    GENERIC_WRITE,
+                      0x00,
+                        nullptr,
+                          CREATE_ALWAYS,
+                            FILE_ATTRIBUTE_NORMAL |
+                            FILE_FLAG_SEQUENTIAL_SCAN,
+                              nullptr );
+
+  bool written = false;
+
+  if (hFile != INVALID_HANDLE_VALUE) {
+    DWORD dwWritten = 0UL;
+
+    written = WriteFile (hFile, job.data, (DWORD)job.size, &dwWritten, nullptr) &&
+              dwWritten == job.size;
+
+    CloseHandle (hFile);
+
+    if (written)
+      written = MoveFileExW (wszTempName, wszFileName, MOVEFILE_REPLACE_EXISTING) != FALSE;
+
+    if (! written)
+      DeleteFileW (wszTempName);
+  }
+
+  EnterCriticalSection (&cs_disk);
+  {
+    pending_.erase (job.key);
+
+    if (written) {
+      entries_ [job.key] = { job.size, ((uint64_t)now.dwHighDateTime << 32ULL) |
+                                                  now.dwLowDateTime };
+      bytes_            += job.size;
+    }
+  }
+  LeaveCriticalSection (&cs_disk);
+
+  free (job.data);
+  job.data = nullptr;
+}
+
+void
+SK_TextureDiskCache::trim (void)
+{
+  const int64_t cap =
+    (int64_t)config.textures.disk_in_mib * 1024LL * 1024LL;
+
+  // Trim a little extra so that this does not run after every write
+  const int64_t target = cap - cap / 10;
+
+  std::vector <std::pair <uint64_t, uint64_t>> by_age;
+
+  int64_t size = 0LL;
+
+  EnterCriticalSection (&cs_disk);
+  {
+    size = bytes_;
+
+    if (size > cap) {
+      for (auto it : entries_)
+        by_age.push_back (std::make_pair (it.second.last_used, it.first));
+    }
+  }
+  LeaveCriticalSection (&cs_disk);
+
+  if (size <= cap)
+    return;
+
+  std::sort (by_age.begin (), by_age.end ());
+
+  int     removed   = 0;
+  int64_t reclaimed = 0LL;
+
+  for (auto it = by_age.begin (); it != by_age.end () && size > target; ++it) {
+    wchar_t wszFileName [MAX_PATH];
+    fileName (it->second, wszFileName);
+
+    DeleteFileW (wszFileName);
+
+    EnterCriticalSection (&cs_disk);
+    {
+      auto entry = entries_.find (it->second);
+
+      if (entry != entries_.end ()) {
+        bytes_    -= entry->second.size;
+        reclaimed += entry->second.size;
+
+        entries_.erase (entry);
+      }
+
+      size = bytes_;
+    }
+    LeaveCriticalSection (&cs_disk);
+
+    ++removed;
+  }
+
+  tex_log->Log ( L"[Disk Cache] Trimmed %lu textures (%7.2f MiB)",
+                   removed,
+                     (double)reclaimed / (1024.0 * 1024.0) );
+}
+
+unsigned int
+__stdcall
+SK_TextureDiskCache::Writer (LPVOID user)
+{
+  SK_TextureDiskCache* pCache =
+    (SK_TextureDiskCache *)user;
+
+  SetThreadPriority ( GetCurrentThread (),
+                        THREAD_PRIORITY_LOWEST |
+                        THREAD_MODE_BACKGROUND_BEGIN );
+
+  HANDLE wait_objs [] = { pCache->events_.work,
+                          pCache->events_.shutdown };
+
+  while (WaitForMultipleObjects (2, wait_objs, FALSE, INFINITE) == WAIT_OBJECT_0) {
+    std::vector <write_s> writes;
+
+    EnterCriticalSection (&pCache->cs_disk);
+    {
+      writes.swap (pCache->writes_);
+    }
+    LeaveCriticalSection (&pCache->cs_disk);
+
+    for (auto it = writes.begin (); it != writes.end (); ++it)
+      pCache->write (*it);
+
+    pCache->trim ();
+  }
+
+  SetThreadPriority ( GetCurrentThread (),
+                        THREAD_MODE_BACKGROUND_END );
+
+  _endthreadex (0);
+
+  return 0;
+}
+
+bool
+SK_TextureRAMCache::fetch (uint32_t checksum, void** ppData, size_t* pSize)
+{
+  if (! enabled ())
+    return false;
+
+  bool hit = false;
+
+  EnterCriticalSection (&cs_ram);
+  {
+    auto entry = entries_.find (checksum);
+
+    if ( entry != entries_.end () &&
+         (*ppData = streaming_memory::alloc (entry->second.size)) != nullptr ) {
+      *pSize  = entry->second.size;
+
+      memcpy (*ppData, entry->second.data, *pSize);
+
+      entry->second.last_used = timeGetTime ();
+
+      if (entry->second.prefetched) {
+        entry->second.prefetched = false;
+
+        InterlockedIncrement (&prefetch_hits_);
+      }
+
+      hit = true;
+    }
+  }
+  LeaveCriticalSection (&cs_ram);
+
+  if (hit) InterlockedIncrement (&hits_);
+  else     InterlockedIncrement (&misses_);
+
+  return hit;
+}
+
+bool
+pending_restores (void)
+{
+  return reset_shadows.pending ();
+}
+
+#define TSFIX_CONTENT_INDEX TSFIX_TEXTURE_DIR L"\\cache\\contents.idx"
+
+void TSFix_InjectFileName (uint32_t checksum, const tsf_tex_record_s& record, wchar_t* wszFileName);
+
+//
+// CRC-64 of the decompressed data of every injectable texture, so that
+//   identical overrides are shared even before either one has been loaded.
+//
+//   Hashing means reading, and for archives decompressing, everything once.
+//     A low priority thread does that after Init, and the results are kept
+//       in contents.idx, keyed by the archive's id or the loose file's size
+//         and write time; later runs only hash what was added or changed.
+//
+class SK_TextureContentIndex {
+public:
+  struct entry_s {
+    uint32_t checksum;
+    uint32_t source;   // Archive id, 0 for loose files
+    uint32_t size;
+    uint32_t reserved;
+    uint64_t written;  // Loose files: last write time (the id covers archives)
+    uint64_t content;
+  };
+
+  // While injectable_textures is still populated, after tex_policy is built
+  void init     (void);
+  void shutdown (void);
+
+  // 0 if it has not been hashed (yet)
+  uint64_t find (uint32_t checksum)
+  {
+    uint64_t content = 0ULL;
+
+    EnterCriticalSection (&cs_index);
+    {
+      auto entry = entries_.find (checksum);
+
+      if (entry != entries_.end ())
+        content = entry->second.content;
+    }
+    LeaveCriticalSection (&cs_index);
+
+    return content;
+  }
+
+  // Hashed by a load that got to it before the index thread did
+  void store (uint32_t checksum, uint64_t content);
+
+  ULONG hashed (void) const { return hashed_; }
+
+protected:
+  static void keyOf (uint32_t checksum, const tsf_tex_record_s& rec, entry_s* key)
+  {
+    const bool archived =
+      rec.archive < archive_ids.size ();
+
+    key->checksum = checksum;
+    key->source   = archived ? archive_ids [rec.archive] : 0UL;
+    key->size     = (uint32_t)rec.size;
+    key->reserved = 0UL;
+    key->written  = archived ? 0ULL : rec.written;
+    key->content  = 0ULL;
+  }
+
+  // Waits while textures are streaming, false once shutting down
+  bool quiet (void);
+
+  void load       (void);
+  void save       (void);
+  void hashLoose  (uint32_t checksum, const tsf_tex_record_s& rec);
+  void hashFolder ( SK_TextureArchive*                         pArc,
+                    UInt32                                     folder,
+                    const std::vector <std::pair <uint32_t, int>>& files );
+
+  static unsigned int __stdcall ThreadProc (LPVOID user);
+
+private:
+  struct header_s {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t reserved;
+  };
+
+  static const uint32_t MAGIC   = 0x58444943UL; // "CIDX"
+  static const uint32_t VERSION = 1UL;
+
+  std::unordered_map <uint32_t, entry_s> entries_;
+  std::vector        <uint32_t>          todo_;     // Not in contents.idx
+  bool                                   dirty_  = false;
+  volatile LONG                          hashed_ = 0L;
+
+  HANDLE           thread_   = nullptr;
+  HANDLE           shutdown_ = nullptr;
+  CRITICAL_SECTION cs_index;
+} content_index;
+
+void
+SK_TextureContentIndex::init (void)
+{
+  InitializeCriticalSectionAndSpinCount (&cs_index, 1000UL);
+
+  load ();
+
+  for (auto it : injectable_textures) {
+    if (! entries_.count (it.first))
+      todo_.push_back (it.first);
+  }
+
+  std::set <uint64_t> distinct;
+
+  for (auto it : entries_)
+    distinct.insert (it.second.content);
+
+  tex_log->Log ( L"[Inject Tex] Content index: %lu of %lu injectable textures hashed, "
+                 L"%lu identical to another",
+                   entries_.size (),
+                     injectable_textures.size (),
+                       entries_.size () - distinct.size () );
+
+  if (todo_.empty ())
+    return;
+
+  shutdown_ = CreateEvent (nullptr, TRUE, FALSE, nullptr);
+
+  thread_ =
+    (HANDLE)_beginthreadex ( nullptr,
+                               0,
+                                 ThreadProc,
+                                   this,
+                                     0x00,
+                                       nullptr );
+}
+
+void
+SK_TextureContentIndex::shutdown (void)
+{
+  if (thread_ != nullptr) {
+    SetEvent            (shutdown_);
+    WaitForSingleObject (thread_, INFINITE);
+
+    CloseHandle (thread_);
+    CloseHandle (shutdown_);
+
+    thread_ = nullptr;
+  }
+
+  // Whatever was hashed before shutdown still counts next time
+  save ();
+
+  DeleteCriticalSection (&cs_index);
+}
+
+void
+SK_TextureContentIndex::store (uint32_t checksum, uint64_t content)
+{
+  const tsf_tex_record_s* rec =
+    tex_policy.injectable (checksum);
+
+  if (rec == nullptr || content == 0ULL)
+    return;
+
+  entry_s entry;
+  keyOf (checksum, *rec, &entry);
+
+  entry.content = content;
+
+  EnterCriticalSection (&cs_index);
+  {
+    if (! entries_.count (checksum)) {
+      entries_ [checksum] = entry;
+      dirty_              = true;
+    }
+  }
+  LeaveCriticalSection (&cs_index);
+}
+
+// Entries whose archive or file changed since they were hashed are left out
+void
+SK_TextureContentIndex::load (void)
+{
+  HANDLE hFile =
+    CreateFileW ( TSFIX_CONTENT_INDEX,
+                    GENERIC_READ,
+                      FILE_SHARE_READ,
+                        nullptr,
+                          OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL |
+                            FILE_FLAG_SEQUENTIAL_SCAN,
+                              nullptr );
+
+  if (hFile == INVALID_HANDLE_VALUE)
+    return;
+
+  header_s      header = { 0 };
+  DWORD         read   = 0UL;
+  LARGE_INTEGER length = { 0LL };
+
+  if (! GetFileSizeEx (hFile, &length))
+    length.QuadPart = 0LL;
+
+  // What follows the header, it has to hold exactly header.count entries
+  //   before anything is allocated for them; a truncated or garbage file
+  //     is thrown away and rebuilt.
+  LONGLONG body =
+    length.QuadPart - (LONGLONG)sizeof (header);
+
+  if ( body >= 0LL && body <= (LONGLONG)MAXDWORD &&
+       body % sizeof (entry_s) == 0              &&
+       ReadFile (hFile, &header, sizeof (header), &read, nullptr) &&
+       read           == sizeof (header)         &&
+       header.magic   == MAGIC                   &&
+       header.version == VERSION                 &&
+       header.count   == body / sizeof (entry_s) ) {
+    std::vector <entry_s> entries (header.count);
+
+    DWORD size = (DWORD)body;
+
+    if ( header.count == 0 ||
+         (ReadFile (hFile, entries.data (), size, &read, nullptr) && read == size) ) {
+      for (auto it : entries) {
+        auto rec = injectable_textures.find (it.checksum);
+
+        if (rec == injectable_textures.end ())
+          continue;
+
+        entry_s key;
+        keyOf (it.checksum, rec->second, &key);
+
+        if ( key.source  == it.source &&
+             key.size    == it.size   &&
+             key.written == it.written )
+          entries_ [it.checksum] = it;
+      }
+
+      dirty_ = entries_.size () != entries.size ();
+    }
+  }
+
+  CloseHandle (hFile);
+}
+
+void
+SK_TextureContentIndex::save (void)
+{
+  std::vector <entry_s> entries;
+
+  EnterCriticalSection (&cs_index);
+  {
+    if (dirty_) {
+      for (auto it : entries_)
+        entries.push_back (it.second);
+
+      dirty_ = false;
+    }
+  }
+  LeaveCriticalSection (&cs_index);
+
+  if (entries.empty ())
+    return;
+
+  CreateDirectoryW (TSFIX_TEXTURE_DIR,            nullptr);
+  CreateDirectoryW (TSFIX_TEXTURE_DIR L"\\cache", nullptr);
+
+  // Same as the disk cache, never leave a partially written index behind
+  wchar_t wszTempName [MAX_PATH];
+  _swprintf (wszTempName, L"%s.tmp", TSFIX_CONTENT_INDEX);
+
+  HANDLE hFile =
+    CreateFileW ( wszTempName,
+                    GENERIC_WRITE,
+                      0x00,
+                        nullptr,
+                          CREATE_ALWAYS,
+                            FILE_ATTRIBUTE_NORMAL |
+                            FILE_FLAG_SEQUENTIAL_SCAN,
+                              nullptr );
+
+  if (hFile == INVALID_HANDLE_VALUE)
+    return;
+
+  header_s header = { MAGIC, VERSION, (uint32_t)entries.size (), 0UL };
+
+  DWORD size    = (DWORD)(entries.size () * sizeof (entry_s));
+  DWORD written = 0UL;
+
+  bool ok =
+    WriteFile (hFile, &header, sizeof (header), &written, nullptr) &&
+      written == sizeof (header);
+
+  ok = ok &&
+    WriteFile (hFile, entries.data (), size, &written, nullptr) &&
+      written == size;
+
+  CloseHandle (hFile);
+
+  if (ok)
+    ok = MoveFileExW (wszTempName, TSFIX_CONTENT_INDEX, MOVEFILE_REPLACE_EXISTING) != FALSE;
+
+  if (! ok)
+    DeleteFileW (wszTempName);
+}
+
+//
+// Overrides with identical contents, shared by every texture that maps to
+//   them. Holds no references of its own, each user holds one; the first
+//     user is the one charged for its memory.
+//
+struct tsf_shared_override_s {
+  IDirect3DTexture9*            pTex = nullptr;
+  std::vector <ISKTextureD3D9*> users;
+};
+
+std::unordered_map <uint64_t, tsf_shared_override_s> shared_overrides;
+CRITICAL_SECTION                                     cs_shared;
+ULONG                                                shared_loads = 0UL;
+
+uint64_t
+TSFix_ContentHash (uint32_t checksum)
+{
+  return content_index.find (checksum);
+}
+
+// Makes pSKTex use the resident override with the same contents, if any
+bool
+TSFix_AttachSharedOverride (ISKTextureD3D9* pSKTex, uint64_t content)
+{
+  if (content == 0ULL || pSKTex->pTexOverride != nullptr)
+    return false;
+
+  bool attached = false;
+
+  EnterCriticalSection (&cs_shared);
+  {
+    auto shared = shared_overrides.find (content);
+
+    if (shared != shared_overrides.end ()) {
+      shared->second.pTex->AddRef ();
+      shared->second.users.push_back (pSKTex);
+
+      pSKTex->pTexOverride  = shared->second.pTex;
+      pSKTex->override_size = 0;       // Charged to the first user
+      pSKTex->override_lod  = 0;
+      pSKTex->override_hash = content;
+
+      pSKTex->restore_pending = false;
+
+      attached = true;
+    }
+  }
+  LeaveCriticalSection (&cs_shared);
+
+  if (attached) {
+    InterlockedIncrement (&shared_loads);
+
+    tsf::RenderFix::tex_mgr.addInjected (pSKTex);
+  }
+
+  return attached;
+}
+
+// Called before pSKTex releases its reference to the override
+void
+TSFix_DetachSharedOverride (ISKTextureD3D9* pSKTex)
+{
+  if (pSKTex->override_hash == 0ULL)
+    return;
+
+  ISKTextureD3D9* heir = nullptr;
+
+  EnterCriticalSection (&cs_shared);
+  {
+    auto shared = shared_overrides.find (pSKTex->override_hash);
+
+    if (shared != shared_overrides.end ()) {
+      auto& users = shared->second.users;
+      bool  owner = (! users.empty ()) && users.front () == pSKTex;
+
+      users.erase (std::remove (users.begin (), users.end (), pSKTex), users.end ());
+
+      if (users.empty ())
+        shared_overrides.erase (shared);
+
+      // Someone has to be charged for it
+      else if (owner) {
+        heir                = users.front ();
+        heir->override_size = pSKTex->override_size;
+      }
+    }
+  }
+  LeaveCriticalSection (&cs_shared);
+
+  pSKTex->override_hash = 0ULL;
+
+  if (heir != nullptr)
+    tsf::RenderFix::tex_mgr.chargeInjected (heir, heir->override_size);
+}
+
+//
+// Makes a finished load pSKTex's override, unless an identical one finished
+//   first, in which case that one is shared and the new copy discarded.
+//
+void
+TSFix_InstallOverride (ISKTextureD3D9* pSKTex, tsf_tex_load_s* load, size_t vram_size)
+{
+  const bool shareable =
+    load->pSrc != nullptr && load->skip_mips == 0 && load->content != 0ULL;
+
+  if (shareable) {
+    content_index.store (load->checksum, load->content);
+
+    if (TSFix_AttachSharedOverride (pSKTex, load->content)) {
+      tex_log->Log ( L"[Inject Tex] Texture %08x is identical to a resident "
+                     L"override, sharing it", load->checksum );
+
+      load->pSrc->Release ();
+      load->pSrc = nullptr;
+
+      return;
+    }
+  }
+
+  pSKTex->pTexOverride  = load->pSrc;
+  pSKTex->override_size = vram_size;
+  pSKTex->override_lod  = load->skip_mips;
+
+  pSKTex->restore_pending = false;
+
+  tsf::RenderFix::tex_mgr.addInjected (pSKTex);
+
+  if (shareable) {
+    EnterCriticalSection (&cs_shared);
+    {
+      tsf_shared_override_s& shared =
+        shared_overrides [load->content];
+
+      shared.pTex = load->pSrc;
+      shared.users.push_back (pSKTex);
+
+      pSKTex->override_hash = load->content;
+    }
+    LeaveCriticalSection (&cs_shared);
+  }
+}
+
+bool
+TSFix_IsSharedOverride (ISKTextureD3D9* pSKTex)
+{
+  if (pSKTex->override_hash == 0ULL)
+    return false;
+
+  bool shared = false;
+
+  EnterCriticalSection (&cs_shared);
+  {
+    auto it = shared_overrides.find (pSKTex->override_hash);
+
+    shared = it != shared_overrides.end () && it->second.users.size () > 1;
+  }
+  LeaveCriticalSection (&cs_shared);
+
+  return shared;
+}
+
+// Used when a shadow restore fails
+void
+TSFix_RestreamTexture (tsf_tex_load_s* load)
+{
+  // requestRestore (...) added the temporary reference already
+  load->pDest->Release ();
+
+  stream_pool.postJob (load);
+}
+
+//
+// Turns a freshly loaded D3DPOOL_SYSTEMMEM texture into the D3DPOOL_DEFAULT
+//   override, keeping the original as its Reset shadow.
+//
+HRESULT
+TSFix_PromoteShadow (tsf_tex_load_s* load)
+{
+  IDirect3DTexture9* pShadow = load->pSrc;
+
+  D3DSURFACE_DESC desc;
+  pShadow->GetLevelDesc (0, &desc);
+
+  load->pSrc = nullptr;
+
+  HRESULT hr =
+    D3D9CreateTexture_Original ( load->pDevice,
+                                   desc.Width, desc.Height,
+                                     pShadow->GetLevelCount (),
+                                       0x00, desc.Format,
+                                         D3DPOOL_DEFAULT,
+                                           &load->pSrc,
+                                             nullptr );
+
+  if (SUCCEEDED (hr))
+    hr = load->pDevice->UpdateTexture (pShadow, load->pSrc);
+
+  if (SUCCEEDED (hr)) {
+    load->pShadow = pShadow;
+  } else {
+    if (load->pSrc != nullptr)
+      load->pSrc->Release ();
+
+    load->pSrc = nullptr;
+    pShadow->Release ();
+  }
+
+  return hr;
+}
+
+// Loose files only, archived textures are found by their record
+void
+TSFix_InjectFileName (uint32_t checksum, const tsf_tex_record_s& record, wchar_t* wszFileName)
+{
+  if (record.archive != -1)
+    return;
+
+  if (record.method == Streaming || record.method == DontCare)
+    _swprintf ( wszFileName, L"%s\\inject\\textures\\streaming\\%08x%s",
+                  TSFIX_TEXTURE_DIR,
+                    checksum,
+                      TSFIX_TEXTURE_EXT );
+  else if (record.method == Blocking)
+    _swprintf ( wszFileName, L"%s\\inject\\textures\\blocking\\%08x%s",
+                  TSFIX_TEXTURE_DIR,
+                    checksum,
+                      TSFIX_TEXTURE_EXT );
+}
+
+bool
+SK_TextureContentIndex::quiet (void)
+{
+  while (pending_streams ()) {
+    if (WaitForSingleObject (shutdown_, 100UL) != WAIT_TIMEOUT)
+      return false;
+  }
+
+  return WaitForSingleObject (shutdown_, 0UL) == WAIT_TIMEOUT;
+}
+
+void
+SK_TextureContentIndex::hashLoose (uint32_t checksum, const tsf_tex_record_s& rec)
+{
+  wchar_t wszFileName [MAX_PATH] = { L'\0' };
+
+  TSFix_InjectFileName (checksum, rec, wszFileName);
+
+  HANDLE hFile =
+    CreateFileW ( wszFileName,
+                    GENERIC_READ,
+                      FILE_SHARE_READ,
+                        nullptr,
+                          OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL |
+                            FILE_FLAG_SEQUENTIAL_SCAN,
+                              nullptr );
+
+  if (hFile == INVALID_HANDLE_VALUE)
+    return;
+
+  DWORD size = GetFileSize (hFile, nullptr);
+  DWORD read = 0UL;
+
+  void* data = malloc (size);
+
+  if (data != nullptr && ReadFile (hFile, data, size, &read, nullptr) && read == size) {
+    store (checksum, Crc64Calc (data, size));
+
+    InterlockedIncrement (&hashed_);
+  }
+
+  free        (data);
+  CloseHandle (hFile);
+}
+
+//
+// Decompresses the folder once for all of its files that need a hash; a
+//   file that does not match its CRC32 is left for the load path to hash.
+//
+void
+SK_TextureContentIndex::hashFolder ( SK_TextureArchive*                             pArc,
+                                     UInt32                                         folder,
+                                     const std::vector <std::pair <uint32_t, int>>& files )
+{
+  if (! pArc->valid ())
+    return;
+
+  const UInt64 start   = pArc->packStart  (folder);
+  const size_t len     = (size_t)(pArc->packEnd (folder) - start);
+  const size_t out_len = pArc->unpackSize (folder);
+
+  void* in  = malloc (len);
+  void* out = malloc (out_len);
+
+  if ( in  != nullptr && pArc->read (start, in, len) &&
+       out != nullptr && pArc->decode (folder, in, len, out, out_len) ) {
+    for (auto it : files) {
+      const uint8_t* pFile =
+        (const uint8_t *)out + pArc->fileOffset (it.second);
+
+      if (! pArc->verify (it.second, pFile))
+        continue;
+
+      store (it.first, Crc64Calc (pFile, pArc->fileSize (it.second)));
+
+      InterlockedIncrement (&hashed_);
+    }
+  }
+
+  free (out);
+  free (in);
+}
+
+unsigned int
+__stdcall
+SK_TextureContentIndex::ThreadProc (LPVOID user)
+{
+  SK_TextureContentIndex* pIndex =
+    (SK_TextureContentIndex *)user;
+
+  SetThreadPriority ( GetCurrentThread (),
+                        THREAD_PRIORITY_LOWEST |
+                        THREAD_MODE_BACKGROUND_BEGIN );
+
+  // Archived textures are grouped by folder, each one is decompressed once
+  std::map <std::pair <unsigned int, UInt32>, std::vector <std::pair <uint32_t, int>>>
+    folders;
+
+  bool done = true;
+
+  // Loose files first, they are cheap
+  for (auto checksum : pIndex->todo_) {
+    const tsf_tex_record_s* rec =
+      tex_policy.injectable (checksum);
+
+    if (rec == nullptr || pIndex->find (checksum) != 0ULL)
+      continue;
+
+    if (rec->archive < archive_dbs.size ()) {
+      SK_TextureArchive* pArc =
+        archive_dbs [rec->archive];
+
+      folders [std::make_pair (rec->archive, pArc->folderOf (rec->fileno))].push_back (
+        std::make_pair (checksum, rec->fileno)
+      );
+
+      continue;
+    }
+
+    if (! (done = pIndex->quiet ()))
+      break;
+
+    pIndex->hashLoose (checksum, *rec);
+  }
+
+  for (auto it = folders.begin (); done && it != folders.end (); ++it) {
+    if (! (done = pIndex->quiet ()))
+      break;
+
+    pIndex->hashFolder (archive_dbs [it->first.first], it->first.second, it->second);
+  }
+
+  pIndex->save ();
+
+  tex_log->Log ( L"[Inject Tex] Content index: hashed %lu textures in the background%s",
+                   pIndex->hashed_,
+                     done ? L"" : L" (interrupted)" );
+
+  SetThreadPriority (GetCurrentThread (), THREAD_MODE_BACKGROUND_END);
+
+  _endthreadex (0);
+
+  return 0;
+}
+
+//
+// Reads the header of the image in load->pSrcData into load->info, hashes
+//   it if its contents are unknown, and limits load->skip_mips to what the
+//     image has.
+//
+HRESULT
+TSFix_ParseOverrideTexture (tsf_tex_load_s* load)
+{
+  HRESULT hr =
+    D3DXGetImageInfoFromFileInMemory (
+      load->pSrcData,
+        load->SrcDataSize,
+          &load->info );
+
+  // Not indexed yet, the index thread is still working through them
+  if (load->content == 0ULL && (! load->user_font))
+    load->content = Crc64Calc (load->pSrcData, load->SrcDataSize);
+
+  // Always keep at least one level
+  load->skip_mips =
+    std::min (load->skip_mips, load->info.MipLevels > 1 ? load->info.MipLevels - 1 : 0);
+
+  return hr;
+}
+
+//
+// Creates load->pSrc from the image in load->pSrcData, leaving out the top
+//   load->skip_mips levels if this is a downgraded copy of an override.
+//
+//   exact_size: Use the image's own dimensions and format, rather than
+//                 letting D3DX pick them.
+//
+HRESULT
+TSFix_CreateOverrideTexture ( tsf_tex_load_s* load,
+                              D3DPOOL         pool,
+                              bool            exact_size )
+{
+  D3DXIMAGE_INFO* pInfo = &load->info;
+
+  const UINT skip  = load->skip_mips;
+  const bool sized = exact_size || skip > 0;
+
+  return
+    D3DXCreateTextureFromFileInMemoryEx_Original (
+      load->pDevice,
+        load->pSrcData, load->SrcDataSize,
+          sized ? std::max (1U, pInfo->Width  >> skip) : D3DX_DEFAULT,
+          sized ? std::max (1U, pInfo->Height >> skip) : D3DX_DEFAULT,
+            pInfo->MipLevels - skip,
+              0, sized ? pInfo->Format : D3DFMT_FROM_FILE,
+                pool,
+                  D3DX_DEFAULT,
+                    skip > 0 ? D3DX_SKIP_DDS_MIP_LEVELS (skip, D3DX_DEFAULT) :
+                               D3DX_DEFAULT,
+                      0,
+                        pInfo, nullptr,
+                          &load->pSrc );
+}
+
+//
+// Reads a whole loose file into a streaming memory block
+//
+HRESULT
+TSFix_ReadLooseFile (tsf_tex_load_s* load, const wchar_t* wszFilename)
+{
+  HANDLE hTexFile =
+    CreateFile ( wszFilename,
+                   GENERIC_READ,
+                     FILE_SHARE_READ,
+                       nullptr,
+                         OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL |
+                           FILE_FLAG_SEQUENTIAL_SCAN,
+                             nullptr );
+
+  if (hTexFile == INVALID_HANDLE_VALUE)
+    return E_FAIL;
+
+  HRESULT hr   = E_OUTOFMEMORY;
+  DWORD   size = GetFileSize (hTexFile, nullptr);
+  DWORD   read = 0UL;
+
+  load->source = tsf_tex_load_s::FromFile;
+  load->buffer = streaming_memory::alloc (size);
+
+  if (load->buffer != nullptr) {
+    hr = ReadFile (hTexFile, load->buffer, size, &read, nullptr) ?
+           S_OK : E_FAIL;
+
+    load->pSrcData    = load->buffer;
+    load->SrcDataSize = read;
+  } else {
+    // OUT OF MEMORY ?!
+  }
+
+  CloseHandle (hTexFile);
+
+  return hr;
+}
+
+//
+// Finds the texture's data and reads it, unless it is archived: then only
+//   load->source and load->record are set, the read is up to the caller.
+//
+HRESULT
+TSFix_LocateTexture (tsf_tex_load_s* load)
+{
+  // Not part of any texture pack, and never cached
+  if (load->user_font)
+    return TSFix_ReadLooseFile (load, L"font.dds");
+
+  const tsf_tex_record_s* inj_tex =
+    tex_policy.injectable (load->checksum);
+
+  if (inj_tex == nullptr) {
+    tex_log->Log ( L"[Inject Tex]  >> Load Request for Checksum: %X "
+                   L"has no Injection Record !!",
+                     load->checksum );
+
+    return E_NOT_VALID_STATE;
+  }
+
+  load->record  = inj_tex;
+  load->content = content_index.find (load->checksum);
+
+  const bool loose =
+    inj_tex->archive == std::numeric_limits <unsigned int>::max ();
+
+  const bool archived =
+    (! loose) && inj_tex->archive < archive_ids.size ();
+
+  void*  cached_data = nullptr;
+  size_t cached_size = 0;
+
+  //
+  // Load:  From RAM (this texture was loaded before and later evicted),
+  //          or the disk cache (decompressed when it was first loaded)
+  //
+  if (ram_cache.fetch (load->checksum, &cached_data, &cached_size))
+    load->source = tsf_tex_load_s::FromRAMCache;
+
+  else if ( archived &&
+            disk_cache.fetch ( archive_ids [inj_tex->archive],
+                                 load->checksum,
+                                   &cached_data, &cached_size ) )
+    load->source = tsf_tex_load_s::FromDiskCache;
+
+  if (cached_data != nullptr) {
+    load->buffer      = cached_data;
+    load->pSrcData    = cached_data;
+    load->SrcDataSize = (UINT)cached_size;
+
+    return S_OK;
+  }
+
+  //
+  // Load:  From Regular Filesystem
+  //
+  if (loose)
+  {
+    wchar_t wszFilename [MAX_PATH] = { L'\0' };
+
+    TSFix_InjectFileName (load->checksum, *inj_tex, wszFilename);
+
+    return TSFix_ReadLooseFile (load, wszFilename);
+  }
+
+  //
+  // Load:  From (Compressed) Archive (.7z or .zip)
+  //
+  SK_TextureArchive* pArc =
+    archived ? archive_dbs [inj_tex->archive] : nullptr;
+
+  if (pArc == nullptr || (! pArc->valid ())) {
+    tex_log->Log ( L"[Inject Tex]  ** Cannot open archive file: %s",
+                     pArc != nullptr ? pArc->name () : L"INVALID" );
+    return E_FAIL;
+  }
+
+  load->source = tsf_tex_load_s::FromArchive;
+
+  return S_OK;
+}
+
+//
+// I/O stage, as one step: finds the texture's data and reads all of it
+//   with one sequential read; for archived textures, the folder's
+//     compressed data.
+//
+HRESULT
+TSFix_ReadTexture (tsf_tex_load_s* load)
+{
+  HRESULT hr =
+    TSFix_LocateTexture (load);
+
+  if ( FAILED (hr) || load->source != tsf_tex_load_s::FromArchive )
+    return hr;
+
+  const tsf_tex_record_s* inj_tex = load->record;
+  SK_TextureArchive*      pArc    = archive_dbs [inj_tex->archive];
+
+  const UInt32 folder = pArc->folderOf  (inj_tex->fileno);
+  const UInt64 start  = pArc->packStart (folder);
+  const size_t len    = (size_t)(pArc->packEnd (folder) - start);
+
+  load->buffer = streaming_memory::alloc (len);
+
+  if (load->buffer == nullptr)
+    return E_OUTOFMEMORY;
+
+  load->pSrcData    = load->buffer;
+  load->SrcDataSize = (UINT)len;
+
+  if (! pArc->read (start, load->buffer, len)) {
+    tex_log->Log ( L"[Inject Tex]  ** Cannot read %08x from archive file: %s",
+                     load->checksum,
+                       pArc->name () );
+    return E_FAIL;
+  }
+
+  return S_OK;
+}
+
+// Copies a job's file out of a folder that another job decoded
+HRESULT
+TSFix_SliceFolder (tsf_tex_load_s* load, SK_TextureArchive* pArc, const void* pFolder)
+{
+  const int fileno = load->record->fileno;
+
+  load->SrcDataSize = (UINT)pArc->fileSize (fileno);
+  load->buffer      = streaming_memory::alloc (load->SrcDataSize);
+  load->pSrcData    = load->buffer;
+
+  if (load->buffer == nullptr)
+    return E_OUTOFMEMORY;
+
+  memcpy ( load->buffer,
+             (const uint8_t *)pFolder + pArc->fileOffset (fileno),
+               load->SrcDataSize );
+
+  if (! pArc->verify (fileno, load->pSrcData)) {
+    tex_log->Log ( L"[Inject Tex]  ** Cannot decompress %08x from archive file: %s",
+                     load->checksum,
+                       pArc->name () );
+    return E_FAIL;
+  }
+
+  return TSFix_LoadCancelled (load) ? E_ABORT :
+                                      TSFix_ParseOverrideTexture (load);
+}
+
+// Anything but running out of memory means that the data itself is bad
+static bool
+TSFix_CachedCopyRejected (tsf_tex_load_s* load, HRESULT hr)
+{
+  const bool cached =
+    load->source == tsf_tex_load_s::FromRAMCache ||
+    load->source == tsf_tex_load_s::FromDiskCache;
+
+  return cached && FAILED (hr) && hr != E_ABORT         &&
+                                  hr != E_OUTOFMEMORY   &&
+                                  hr != D3DERR_OUTOFVIDEOMEMORY;
+}
+
+//
+// A copy from the RAM or disk cache that D3DX rejected: forgets it, so that
+//   later requests do not hit it again, and loads this one from the archive
+//     or file instead.
+//
+HRESULT
+TSFix_LoadUncached (tsf_tex_load_s* load)
+{
+  tex_log->Log ( L"[Inject Tex]  ** Cached copy of %08x is corrupt, "
+                 L"loading it from its source",
+                   load->checksum );
+
+  ram_cache.remove (load->checksum);
+
+  const tsf_tex_record_s* inj_tex = load->record;
+
+  if ( inj_tex != nullptr &&
+       inj_tex->archive != std::numeric_limits <unsigned int>::max () &&
+       inj_tex->archive <  archive_ids.size () )
+    disk_cache.remove (archive_ids [inj_tex->archive], load->checksum);
+
+  if (load->pSrc != nullptr) {
+    load->pSrc->Release ();
+    load->pSrc = nullptr;
+  }
+
+  streaming_memory::release (load->buffer);
+
+  load->buffer      = nullptr;
+  load->pSrcData    = nullptr;
+  load->SrcDataSize = 0;
+
+  HRESULT hr =
+    TSFix_ReadTexture (load);
+
+  // Should the cache have been refilled in the meantime, give up on this one
+  if (SUCCEEDED (hr) && load->source != tsf_tex_load_s::FromArchive &&
+                        load->source != tsf_tex_load_s::FromFile)
+    hr = E_FAIL;
+
+  if (SUCCEEDED (hr))
+    hr = TSFix_LoadCancelled (load) ? E_ABORT : TSFix_DecodeTexture (load);
+
+  return hr;
+}
+
+//
+// Decode stage: decompresses an archived texture's folder (everything else
+//   arrives decompressed) and reads the image header. Jobs chained to it
+//     through folder_next get their part of the folder and their header.
+//
+HRESULT
+TSFix_DecodeTexture (tsf_tex_load_s* load)
+{
+  if (load->source == tsf_tex_load_s::FromArchive) {
+    SK_TextureArchive* pArc =
+      archive_dbs [load->record->archive];
+
+    const int    fileno  = load->record->fileno;
+    const UInt32 folder  = pArc->folderOf   (fileno);
+    const size_t out_len = pArc->unpackSize (folder);
+
+    void* out =
+      streaming_memory::alloc (out_len);
+
+    if (out == nullptr)
+      return E_OUTOFMEMORY;
+
+    bool decoded =
+      pArc->decode ( folder,
+                       load->pSrcData, load->SrcDataSize,
+                         out,          out_len );
+
+    streaming_memory::release (load->buffer);
+
+    load->buffer      = out;
+    load->pSrcData    = (uint8_t *)out + pArc->fileOffset (fileno);
+    load->SrcDataSize = (UINT)pArc->fileSize (fileno);
+
+    // Everything requested from this folder along with it gets a copy
+    for ( tsf_tex_load_s* mate  = load->folder_next;
+                          mate != nullptr;
+                          mate  = mate->folder_next ) {
+      mate->status =
+        decoded ? TSFix_SliceFolder (mate, pArc, out) : E_FAIL;
+    }
+
+    if ((! decoded) || (! pArc->verify (fileno, load->pSrcData))) {
+      tex_log->Log ( L"[Inject Tex]  ** Cannot decompress %08x from archive file: %s",
+                       load->checksum,
+                         pArc->name () );
+      return E_FAIL;
+    }
+
+    // It only decoded the folder for the others
+    if (TSFix_LoadCancelled (load))
+      return E_ABORT;
+  }
+
+  HRESULT hr =
+    TSFix_ParseOverrideTexture (load);
+
+  if (TSFix_CachedCopyRejected (load, hr))
+    hr = TSFix_LoadUncached (load);
+
+  return hr;
+}
+
+//
+// Create stage: the texture itself, then copies of its data for the RAM and
+//   disk caches.
+//
+HRESULT
+TSFix_CreateTexture (tsf_tex_load_s* load)
+{
+  // The render thread does the uploads, at the end of a frame
+  const bool staged =
+    config.textures.upload_kib > 0;
+
+  // With shadows enabled, load into system memory and upload from there
+  const D3DPOOL pool =
+    reset_shadows.enabled () || staged ? D3DPOOL_SYSTEMMEM :
+                                         D3DPOOL_DEFAULT;
+
+  // Decided by what the texture is, not where its bytes came from, so that
+  //   a copy from the RAM or disk cache is created just like the original.
+  const bool exact_size =
+    load->record          != nullptr &&
+    load->record->archive != std::numeric_limits <unsigned int>::max ();
+
+  HRESULT hr =
+    TSFix_CreateOverrideTexture (load, pool, exact_size);
+
+  if (TSFix_CachedCopyRejected (load, hr)) {
+    hr = TSFix_LoadUncached (load);
+
+    if (SUCCEEDED (hr))
+      hr = TSFix_CreateOverrideTexture (load, pool, exact_size);
+  }
+
+  const bool archived =
+    load->source == tsf_tex_load_s::FromArchive;
 
- LONG streaming       = 0;
-ULONG streaming_bytes = 0UL;
+  if (SUCCEEDED (hr) && (! load->user_font)) {
+    if (load->source != tsf_tex_load_s::FromRAMCache)
+      ram_cache.store (load->checksum, load->pSrcData, load->SrcDataSize);
 
-int resampling = 0;
+    if (archived) {
+      disk_cache.store ( archive_ids [load->record->archive],
+                           load->checksum,
+                             load->pSrcData, load->SrcDataSize );
+    }
+  }
 
-bool
-pending_loads (void)
-{
-  return stream_pool.working ();
+  // Created, but nobody wants it anymore; skip the upload
+  if (SUCCEEDED (hr) && TSFix_LoadCancelled (load)) {
+    load->pSrc->Release ();
+    load->pSrc = nullptr;
+
+    hr = E_ABORT;
+  }
+
+  if (SUCCEEDED (hr) && staged)
+    load->staged = true;
+
+  else if (SUCCEEDED (hr) && pool == D3DPOOL_SYSTEMMEM)
+    hr = TSFix_PromoteShadow (load);
+
+  return hr;
 }
 
+//
+// Creates the mips of a large DDS override that fit in preview_size and
+//   hands them to the render thread ahead of the full chain, which can
+//     take a while to be created and uploaded after this.
+//
 void
-start_load (void)
+TSFix_PreviewTexture (tsf_tex_load_s* load)
 {
-  EnterCriticalSection (&cs_tex_inject);
+  if (config.textures.preview_size <= 0)
+    return;
+
+  const UINT max_dim = (UINT)config.textures.preview_size;
+  const UINT top_dim = std::max (load->info.Width, load->info.Height);
+
+  // Only worth it when the full chain is at least 4x as large in each
+  //   dimension, is for a texture that has nothing to draw yet, and is not
+  //     just being prefetched. Blocking loads qualify too, a bind that waits
+  //       for one of them on a worker stops waiting once this is out.
+  if ( top_dim                    <  max_dim * 4                   ||
+       load->info.ImageFileFormat != D3DXIFF_DDS                   ||
+       ( load->type               != tsf_tex_load_s::Stream &&
+         load->type               != tsf_tex_load_s::Immediate )   ||
+       load->skip_mips            != 0                             ||
+       load->priority             >  PriorityStreaming             ||
+       ((ISKTextureD3D9 *)load->pDest)->pTexOverride != nullptr    ||
+       TSFix_LoadCancelled (load) )
+    return;
+
+  UINT skip = 0;
+
+  while ((top_dim >> skip) > max_dim)
+    ++skip;
+
+  // Not enough mip levels in the file to get down that far
+  if (skip >= load->info.MipLevels)
+    return;
+
+  tsf_tex_load_s* preview = load_pool.alloc ();
+
+  preview->type        = tsf_tex_load_s::Preview;
+  preview->pDevice     = load->pDevice;
+  preview->checksum    = load->checksum;
+  preview->priority    = load->priority;
+  preview->pSrcData    = load->pSrcData;
+  preview->SrcDataSize = load->SrcDataSize;
+  preview->info        = load->info;
+  preview->skip_mips   = skip;
+  preview->freq        = load->freq;
+  preview->start       = load->start;
+
+  // The job's own reference keeps pDest alive until after this completes
+  preview->pDest       = load->pDest;
+
+  HRESULT hr =
+    TSFix_CreateOverrideTexture (preview, D3DPOOL_DEFAULT, true);
+
+  preview->pSrcData = nullptr;
+
+  if (FAILED (hr)) {
+    load_pool.free (preview);
+    return;
+  }
 
-  inject_tids.insert (GetCurrentThreadId ());
+  QueryPerformanceCounter_Original (&preview->end);
 
-  LeaveCriticalSection (&cs_tex_inject);
+  stream_pool.postPreview (load, preview);
 }
 
-void
-end_load (void)
+// The decode stage's step: previews go out as soon as there is data for them
+HRESULT
+TSFix_DecodeStage (tsf_tex_load_s* load)
 {
-  EnterCriticalSection (&cs_tex_inject);
+  HRESULT hr =
+    TSFix_DecodeTexture (load);
 
-  inject_tids.erase (GetCurrentThreadId ());
+  if (SUCCEEDED (hr))
+    TSFix_PreviewTexture (load);
+
+  for ( tsf_tex_load_s* mate  = load->folder_next;
+                        mate != nullptr;
+                        mate  = mate->folder_next ) {
+    if (SUCCEEDED (mate->status))
+      TSFix_PreviewTexture (mate);
+  }
 
-  LeaveCriticalSection (&cs_tex_inject);
+  return hr;
 }
 
-bool
-pending_streams (void)
+// Every stage, one after another on the calling thread
+HRESULT
+InjectTexture (tsf_tex_load_s* load)
 {
-  bool ret = false;
+  HRESULT hr =
+    TSFix_ReadTexture (load);
 
-  if (streaming || stream_pool.queueLength ())
-    ret = true;
+  if (SUCCEEDED (hr))
+    hr = TSFix_LoadCancelled (load) ? E_ABORT : TSFix_DecodeTexture (load);
 
-  return ret;
+  if (SUCCEEDED (hr))
+    hr = TSFix_LoadCancelled (load) ? E_ABORT : TSFix_CreateTexture (load);
+
+  return hr;
 }
 
-bool
-is_streaming (uint32_t checksum)
-{
-  bool ret = false;
+//
+// Uses the time the game spends in the background or in a menu to put the
+//   overrides it asked for recently back into the RAM cache, decompressed,
+//     if they are not in there anymore. One low priority thread, which stops
+//       taking work as soon as the game is back to needing the CPU and disk.
+//
+//   The same thread decodes what the scene predictor expects an area to
+//     need, that is wanted whatever the game is doing.
+//
+class SK_IdlePrefetcher {
+public:
+  void init (void)
+  {
+    InitializeCriticalSectionAndSpinCount (&cs_history, 1000UL);
 
-  EnterCriticalSection (&cs_tex_stream);
+    if ( (! ram_cache.enabled ()) ||
+         (! (config.textures.idle_prefetch || config.textures.scene_prefetch)) )
+      return;
 
-  if (textures_in_flight.count (checksum))
-    ret = true;
+    shutdown_ = CreateEvent (nullptr, TRUE, FALSE, nullptr);
+    work_     = CreateEvent (nullptr, FALSE, FALSE, nullptr);
+
+    thread_ =
+      (HANDLE)_beginthreadex ( nullptr,
+                                 0,
+                                   ThreadProc,
+                                     this,
+                                       0x00,
+                                         nullptr );
+  }
 
-  LeaveCriticalSection (&cs_tex_stream);
+  void shutdown (void)
+  {
+    if (thread_ != nullptr) {
+      SetEvent            (shutdown_);
+      WaitForSingleObject (thread_, INFINITE);
 
-  return ret;
-}
+      CloseHandle (thread_);
+      CloseHandle (shutdown_);
+      CloseHandle (work_);
 
-void
-finished_streaming (uint32_t checksum)
-{
-  EnterCriticalSection (&cs_tex_stream);
+      thread_ = nullptr;
+    }
 
-  if (textures_in_flight.count (checksum))
-    textures_in_flight.erase (checksum);
+    DeleteCriticalSection (&cs_history);
+  }
 
-  LeaveCriticalSection (&cs_tex_stream);
-}
+  bool running (void) const { return thread_ != nullptr; }
 
-HANDLE decomp_semaphore;
+  // Replaces whatever was predicted for the previous area
+  void predict (const std::vector <uint32_t>& checksums)
+  {
+    if (thread_ == nullptr || (! config.textures.scene_prefetch))
+      return;
 
-// Keep a pool of memory around so that we are not allocating and freeing
-//  memory constantly...
-namespace streaming_memory {
-  std::unordered_map <DWORD, void*>    data;
-  std::unordered_map <DWORD, size_t>   data_len;
-  std::unordered_map <DWORD, uint32_t> data_age;
+    EnterCriticalSection (&cs_history);
+    {
+      predicted_.assign (checksums.begin (), checksums.end ());
+    }
+    LeaveCriticalSection (&cs_history);
+
+    SetEvent (work_);
+  }
 
-  bool alloc (size_t len, DWORD dwThreadId = GetCurrentThreadId ())
+  // The game asked for this override
+  void noteRequest (uint32_t checksum)
   {
-    if (data_len [dwThreadId] < len) {
-      if (data [dwThreadId] != nullptr)
-        free (data [dwThreadId]);
+    if (thread_ == nullptr)
+      return;
 
-      if (len < 8192 * 1024)
-        data_len [dwThreadId] = 8192 * 1024;
-      else
-        data_len [dwThreadId] = len;
+    EnterCriticalSection (&cs_history);
+    {
+      history_.push_back (checksum);
+
+      if (history_.size () > MAX_HISTORY)
+        history_.pop_front ();
+    }
+    LeaveCriticalSection (&cs_history);
+  }
 
-      data     [dwThreadId] = malloc      (data_len [dwThreadId]);
-      data_age [dwThreadId] = timeGetTime ();
+  // Nothing else wants the CPU or the disk, and the game is not being played
+  static bool idle (void);
 
-      if (data [dwThreadId] != nullptr) {
-        return true;
-      } else {
-        data_len [dwThreadId] = 0;
-        return false;
+  LONG prefetched (void) const { return prefetched_; }
+  LONG bytes      (void) const { return bytes_;      } // KiB
+
+protected:
+  static unsigned int __stdcall ThreadProc (LPVOID user);
+
+  // In the order they were predicted, 0 once there are none left
+  uint32_t nextPredicted (void)
+  {
+    uint32_t checksum = 0;
+
+    EnterCriticalSection (&cs_history);
+    {
+      while (checksum == 0 && (! predicted_.empty ())) {
+        uint32_t candidate = predicted_.front ();
+                             predicted_.pop_front ();
+
+        if ((! ram_cache.contains (candidate)) && (! is_streaming (candidate)))
+          checksum = candidate;
       }
-    } else {
-      return true;
     }
+    LeaveCriticalSection (&cs_history);
+
+    return checksum;
   }
 
-  void trim (size_t max_size, uint32_t min_age, DWORD dwThreadId = GetCurrentThreadId ()) {
-    if (data_age [dwThreadId] < min_age) {
-      if (data_len [dwThreadId] > max_size) {
-        free (data [dwThreadId]);
-        data  [dwThreadId] = nullptr;
+  // Most recently requested first, 0 once there is nothing left to try
+  uint32_t next (void)
+  {
+    uint32_t checksum = 0;
 
-        if (max_size > 0)
-          data [dwThreadId] = malloc (max_size);
+    EnterCriticalSection (&cs_history);
+    {
+      for (auto it = history_.rbegin (); it != history_.rend (); ++it) {
+        if (tried_.count (*it))
+          continue;
 
-        if (data  [dwThreadId] != nullptr) {
-          data_len [dwThreadId] = max_size;
-          data_age [dwThreadId] = timeGetTime ();
-        } else {
-          data_len [dwThreadId] = 0;
-          data_age [dwThreadId] = 0;
+        tried_.insert (*it);
+
+        if ((! ram_cache.contains (*it)) && (! is_streaming (*it))) {
+          checksum = *it;
+          break;
         }
       }
     }
+    LeaveCriticalSection (&cs_history);
+
+    return checksum;
+  }
+
+  //   yield: Give up when the game stops being idle
+  bool prefetch (uint32_t checksum, bool yield);
+
+  //
+  // A decode cannot be interrupted, so when this has to give way to the
+  //   game, only folders that decode within a frame (at the rate measured
+  //     so far) are taken.
+  //
+  size_t frameLen (void) const
+  {
+    const double frame_ms =
+      1000.0 / (config.window.foreground_fps > 0.0f ? config.window.foreground_fps :
+                                                      30.0f);
+
+    const double bytes_per_ms =
+      decode_ms_ > 0.0 ? (double)decode_bytes_ / decode_ms_ :
+                         DEFAULT_BYTES_PER_MS;
+
+    return (size_t)(frame_ms * bytes_per_ms);
+  }
+
+  // It, and everything recently asked for or predicted, in the folder decoded for it
+  void storeFolderMates ( uint32_t checksum, SK_TextureArchive* pArc,
+                          UInt32   folder,   const void*        pFolder );
+
+  void store (uint32_t checksum, const void* data, size_t size)
+  {
+    if (! ram_cache.room (size))
+      return;
+
+    ram_cache.store (checksum, data, size, true);
+
+    InterlockedIncrement   (&prefetched_);
+    InterlockedExchangeAdd (&bytes_, (LONG)(size / 1024));
+  }
+
+private:
+  static const size_t MAX_HISTORY    = 1024;
+  static const DWORD  POLL_MS        = 250UL;
+  static const size_t MAX_FOLDER_LEN = 16 * 1024 * 1024; // Decoding takes too long otherwise
+
+  // Until a decode has been timed; slow enough for any CPU this runs on
+  static const size_t DEFAULT_BYTES_PER_MS = 32 * 1024;
+
+  std::deque <uint32_t> history_;
+  std::deque <uint32_t> predicted_;
+  std::set   <uint32_t> tried_;   // This idle period
+  CRITICAL_SECTION      cs_history;
+
+  HANDLE                thread_   = nullptr;
+  HANDLE                shutdown_ = nullptr;
+  HANDLE                work_     = nullptr; // Something was predicted
+
+  volatile LONG         prefetched_ = 0L;
+  volatile LONG         bytes_      = 0L;
+
+  // Prefetch thread only
+  LONG64                decode_bytes_ = 0LL;
+  double                decode_ms_    = 0.0;
+} idle_prefetch;
+
+// The game's own menu flag (see D3D9EndFrame_Pre), if this is the version of
+//   the game it is at home in.
+bool
+TSFix_InMenu (void)
+{
+  static const volatile uint8_t* pInMenu = nullptr;
+  static bool                    checked = false;
+
+  if (! checked) {
+    MEMORY_BASIC_INFORMATION mbi;
+
+    if ( VirtualQuery ((LPCVOID)0x1C2BD34, &mbi, sizeof mbi) == sizeof mbi &&
+         mbi.State == MEM_COMMIT                                           &&
+         (! (mbi.Protect & (PAGE_NOACCESS | PAGE_GUARD))) )
+      pInMenu = (const volatile uint8_t *)0x1C2BD34;
+
+    checked = true;
   }
+
+  return pInMenu != nullptr && *pInMenu != 0;
 }
 
-HRESULT
-InjectTexture (tsf_tex_load_s* load)
+bool
+SK_IdlePrefetcher::idle (void)
+{
+  if (load_phase.loading () || pending_streams ())
+    return false;
+
+  return (! tsf::window.active) || TSFix_InMenu ();
+}
+
+void
+SK_IdlePrefetcher::storeFolderMates ( uint32_t checksum, SK_TextureArchive* pArc,
+                                      UInt32   folder,   const void*        pFolder )
 {
-  D3DXIMAGE_INFO img_info;
+  std::vector <uint32_t> wanted (1, checksum);
 
-  bool           streamed;
-  size_t         size = 0;
-  HRESULT        hr = E_FAIL;
+  EnterCriticalSection (&cs_history);
+  {
+    wanted.insert (wanted.end (), history_.begin   (), history_.end   ());
+    wanted.insert (wanted.end (), predicted_.begin (), predicted_.end ());
+  }
+  LeaveCriticalSection (&cs_history);
 
-  auto inject = injectable_textures.find (load->checksum);
+  for (auto checksum : wanted) {
+    const tsf_tex_record_s* rec =
+      tex_policy.injectable (checksum);
 
-  if (inject == injectable_textures.end ()) {
-    tex_log->Log ( L"[Inject Tex]  >> Load Request for Checksum: %X "
-                   L"has no Injection Record !!",
-                     load->checksum );
+    if ( rec == nullptr || rec->archive >= archive_dbs.size () ||
+         archive_dbs [rec->archive]  != pArc                  ||
+         pArc->folderOf (rec->fileno) != folder               ||
+         ram_cache.contains (checksum) )
+      continue;
 
-    return E_NOT_VALID_STATE;
+    const uint8_t* data =
+      (const uint8_t *)pFolder + pArc->fileOffset (rec->fileno);
+
+    if (pArc->verify (rec->fileno, data))
+      store (checksum, data, (size_t)pArc->fileSize (rec->fileno));
+  }
+}
+
+//
+// Decodes the archive folder holding the override, the way the load pipeline
+//   would, and stores it in the RAM cache; false if it gave up because the
+//     game needs the time now. Loose files need no decoding, they are left
+//       alone.
+//
+bool
+SK_IdlePrefetcher::prefetch (uint32_t checksum, bool yield)
+{
+  const tsf_tex_record_s* rec =
+    tex_policy.injectable (checksum);
+
+  if (rec == nullptr || rec->archive >= archive_dbs.size ())
+    return true;
+
+  SK_TextureArchive* pArc =
+    archive_dbs [rec->archive];
+
+  const UInt32 folder  = pArc->folderOf   (rec->fileno);
+  const size_t out_len = pArc->unpackSize (folder);
+
+  if ((! pArc->valid ()) || out_len > (yield ? frameLen () : MAX_FOLDER_LEN))
+    return true;
+
+  const UInt64 start = pArc->packStart (folder);
+  const size_t len   = (size_t)(pArc->packEnd (folder) - start);
+
+  void* in =
+    streaming_memory::alloc (len);
+
+  bool read =
+    in != nullptr && pArc->read (start, in, len);
+
+  // Back in the game while this was reading
+  if (read && yield && (! idle ())) {
+    streaming_memory::release (in);
+    return false;
   }
 
-  const tsf_tex_record_s* inj_tex = &(*inject).second;
+  if (read) {
+    void* out =
+      streaming_memory::alloc (out_len);
 
-  streamed =
-    (inj_tex->method == Streaming);
+    LARGE_INTEGER freq, start, end;
 
-  //
-  // Load:  From Regular Filesystem
-  //
-  if ( inj_tex->archive == std::numeric_limits <unsigned int>::max () )
-  {
-    HANDLE hTexFile =
-      CreateFile ( load->wszFilename,
-                     GENERIC_READ,
-                       FILE_SHARE_READ,
-                         nullptr,
-                           OPEN_EXISTING,
-                             FILE_ATTRIBUTE_NORMAL |
-                             FILE_FLAG_SEQUENTIAL_SCAN,
-                               nullptr );
+    QueryPerformanceFrequency        (&freq);
+    QueryPerformanceCounter_Original (&start);
 
-    DWORD read = 0UL;
+    bool decoded =
+      out != nullptr && pArc->decode (folder, in, len, out, out_len);
 
-    if (hTexFile != INVALID_HANDLE_VALUE) {
-                size = GetFileSize (hTexFile, nullptr);
+    QueryPerformanceCounter_Original (&end);
 
-      if (streaming_memory::alloc (size)) {
-        load->pSrcData = streaming_memory::data [GetCurrentThreadId ()];
+    if (decoded) {
+      decode_bytes_ += out_len;
+      decode_ms_    += 1000.0 * (double)(end.QuadPart - start.QuadPart) /
+                                (double)freq.QuadPart;
 
-        ReadFile (hTexFile, load->pSrcData, size, &read, nullptr);
+      storeFolderMates (checksum, pArc, folder, out);
+    }
 
-        load->SrcDataSize = read;
+    streaming_memory::release (out);
+  }
 
-        if (streamed && size > (32 * 1024)) {
-          SetThreadPriority ( GetCurrentThread (),
-                                THREAD_PRIORITY_BELOW_NORMAL |
-                                THREAD_MODE_BACKGROUND_BEGIN );
-        }
+  streaming_memory::release (in);
 
-        D3DXGetImageInfoFromFileInMemory (
-          load->pSrcData,
-            load->SrcDataSize,
-              &img_info );
-
-        hr = D3DXCreateTextureFromFileInMemoryEx_Original (
-          load->pDevice,
-            load->pSrcData, load->SrcDataSize,
-              D3DX_DEFAULT, D3DX_DEFAULT, img_info.MipLevels,
-                0, D3DFMT_FROM_FILE,
-                  D3DPOOL_DEFAULT,
-                    D3DX_DEFAULT, D3DX_DEFAULT,
-                      0,
-                        &img_info, nullptr,
-                          &load->pSrc );
+  return true;
+}
 
-        load->pSrcData = nullptr;
-      } else {
-        // OUT OF MEMORY ?!
+unsigned int
+__stdcall
+SK_IdlePrefetcher::ThreadProc (LPVOID user)
+{
+  SK_IdlePrefetcher* pPrefetch =
+    (SK_IdlePrefetcher *)user;
+
+  SetThreadPriority ( GetCurrentThread (),
+                        THREAD_PRIORITY_LOWEST |
+                        THREAD_MODE_BACKGROUND_BEGIN );
+
+  HANDLE waits [2] = { pPrefetch->shutdown_,
+                       pPrefetch->work_ };
+
+  bool was_idle = false;
+
+  while (WaitForMultipleObjects (2, waits, FALSE, POLL_MS) != WAIT_OBJECT_0) {
+    uint32_t predicted = 0;
+
+    while ( WaitForSingleObject (pPrefetch->shutdown_, 0) == WAIT_TIMEOUT &&
+            (predicted = pPrefetch->nextPredicted ()) != 0 )
+      pPrefetch->prefetch (predicted, false);
+
+    bool is_idle =
+      config.textures.idle_prefetch && idle ();
+
+    // Everything gets another chance each time
+    if (is_idle && (! was_idle)) {
+      EnterCriticalSection (&pPrefetch->cs_history);
+      {
+        pPrefetch->tried_.clear ();
       }
+      LeaveCriticalSection (&pPrefetch->cs_history);
+    }
+
+    was_idle = is_idle;
 
-      CloseHandle (hTexFile);
+    // Checked again after every texture, the game may be back already
+    while ( is_idle &&
+            WaitForSingleObject (pPrefetch->shutdown_, 0) == WAIT_TIMEOUT ) {
+      uint32_t checksum =
+        pPrefetch->next ();
+
+      if (checksum == 0 || (! pPrefetch->prefetch (checksum, true)))
+        break;
+
+      is_idle = idle ();
     }
   }
 
+  SetThreadPriority ( GetCurrentThread (),
+                        THREAD_MODE_BACKGROUND_END );
+
+  _endthreadex (0);
+
+  return 0;
+}
+
+//
+// Areas ask for much the same overrides every time they are entered. For
+//   each PAC file the game loads, remembers which injectable textures were
+//     requested or drawn until the next one, and has them decoded ahead of
+//       the game's requests when it is loaded again.
+//
+//   Scored per visit: precision is how much of a prediction was used, recall
+//     how much of what was used had been predicted.
+//
+class SK_ScenePredictor {
+public:
   //
-  // Load:  From (Compressed) Archive (.7z or .zip)
+  // The PAC hook is live from TimingFix::Init, long before the texture
+  //   manager is, and stays live after it shuts down; so the lock exists for
+  //     the life of the process, and notes outside of init / finish are dropped.
   //
-  else
+  SK_ScenePredictor (void) {
+    InitializeCriticalSectionAndSpinCount (&cs_scene, 1000UL);
+  }
+
+  // Nothing to predict for without the prefetch thread (no RAM cache)
+  void init (void)
   {
-    wchar_t       arc_name [MAX_PATH];
-    CFileInStream arc_stream;
-    CLookToRead   look_stream;
-    ISzAlloc      thread_alloc;
-    ISzAlloc      thread_tmp_alloc;
+    if ((! idle_prefetch.running ()) || (! config.textures.scene_prefetch))
+      return;
 
-    FileInStream_CreateVTable (&arc_stream);
-    LookToRead_CreateVTable   (&look_stream, False);
+    EnterCriticalSection (&cs_scene);
+    {
+      active_ = true;
+    }
+    LeaveCriticalSection (&cs_scene);
+  }
 
-    look_stream.realStream = &arc_stream.s;
-    LookToRead_Init         (&look_stream);
+  // Whichever thread the game loads from
+  void notePAC (const char* szName)
+  {
+    EnterCriticalSection (&cs_scene);
+    {
+      if (active_) {
+        finishVisit ();
 
-    thread_alloc.Alloc     = SzAlloc;
-    thread_alloc.Free      = SzFree;
+        scene_ = szName;
 
-    thread_tmp_alloc.Alloc = SzAllocTemp;
-    thread_tmp_alloc.Free  = SzFreeTemp;
+        InterlockedIncrement (&visit_id_);
 
-    CSzArEx      arc;
-                 size   = inj_tex->size;
-    int          fileno = inj_tex->fileno;
+        auto scene = scenes_.find (scene_);
 
-    if (inj_tex->archive <= archives.size ())
-      wcscpy (arc_name, archives [inj_tex->archive].c_str ());
-    else
-      wcscpy (arc_name, L"INVALID");
+        if (scene != scenes_.end ()) {
+          predicted_.insert (scene->second.begin (), scene->second.end ());
 
-    if (streamed && size > (32 * 1024)) {
-      SetThreadPriority ( GetCurrentThread (),
-                            THREAD_PRIORITY_LOWEST |
-                            THREAD_MODE_BACKGROUND_BEGIN );
+          // Under the lock, finish () has to wait for this before the
+          //   prefetcher can shut down
+          idle_prefetch.predict (scene->second);
+        }
+      }
     }
+    LeaveCriticalSection (&cs_scene);
+  }
 
-    if (InFile_OpenW (&arc_stream.file, arc_name))
+  void noteRequest (uint32_t checksum)
+  {
+    if (! active_)
+      return;
+
+    EnterCriticalSection (&cs_scene);
     {
-      tex_log->Log ( L"[Inject Tex]  ** Cannot open archive file: %s",
-                       arc_name );
-      return E_FAIL;
+      if (! scene_.empty ())
+        seen_.insert (checksum);
+    }
+    LeaveCriticalSection (&cs_scene);
+  }
+
+  //
+  // Render thread, once per frame: everything it drew. Only textures it had
+  //   not drawn yet since the last PAC loaded take the lock, most frames
+  //     draw nothing new.
+  //
+  void noteBound (const std::set <uint32_t>& used)
+  {
+    if (! active_)
+      return;
+
+    const LONG visit = visit_id_;
+
+    if (visit != bound_visit_) {
+      bound_.clear ();
+      bound_visit_ = visit;
+    }
+
+    std::vector <uint32_t> fresh;
+
+    for (auto it : used) {
+      if (bound_.insert (it).second)
+        fresh.push_back (it);
     }
 
-    SzArEx_Init (&arc);
+    if (fresh.empty () || visit == 0L)
+      return;
 
-    if (SzArEx_Open (&arc, &look_stream.s, &thread_alloc, &thread_tmp_alloc) != SZ_OK)
+    EnterCriticalSection (&cs_scene);
     {
-      tex_log->Log ( L"[Inject Tex]  ** Cannot open archive file: %s",
-                       arc_name );
-      return E_FAIL;
+      if (! scene_.empty ())
+        seen_.insert (fresh.begin (), fresh.end ());
     }
+    LeaveCriticalSection (&cs_scene);
+  }
 
-    if (streaming_memory::alloc (size))
+  // Scores the visit in progress and stops taking notes, at shutdown
+  void finish (void)
+  {
+    EnterCriticalSection (&cs_scene);
     {
-      load->pSrcData = streaming_memory::data [GetCurrentThreadId ()];
+      finishVisit ();
 
-      bool wait = true;
+      scene_.clear ();
 
-      while (wait)
-      {
-        DWORD dwResult = WAIT_OBJECT_0;
+      active_ = false;
+    }
+    LeaveCriticalSection (&cs_scene);
+  }
+
+  ULONG  visits    (void) const { return visits_; }
+
+  double precision (void) const {
+    return predicted_total_ > 0 ? 100.0 * (double)hits_ / (double)predicted_total_ : 0.0;
+  }
+
+  double recall    (void) const {
+    return used_total_      > 0 ? 100.0 * (double)hits_ / (double)used_total_      : 0.0;
+  }
+
+protected:
+  // cs_scene held
+  void finishVisit (void)
+  {
+    if (scene_.empty ())
+      return;
+
+    std::vector <uint32_t> used;
+
+    for (auto it : seen_) {
+      if (tex_policy.injectable (it) != nullptr)
+        used.push_back (it);
+    }
+
+    // A PAC loaded right before another one sees next to nothing; neither
+    //   score that, nor forget what it had.
+    if (used.size () >= MIN_SCENE) {
+      if (! predicted_.empty ()) {
+        for (auto it : used)
+          hits_ += (ULONG)predicted_.count (it);
 
-        if (streamed && size > (32 * 1024)) {
-          dwResult =
-            WaitForSingleObject ( decomp_semaphore, INFINITE );
-        }
+        predicted_total_ += (ULONG)predicted_.size ();
+        used_total_      += (ULONG)used.size      ();
 
-        switch (dwResult) 
-        {
-        case WAIT_OBJECT_0:
-        {
-          uint32_t block_idx     = 0xFFFFFFFF;
-          Byte*    out           = (Byte *)streaming_memory::data     [GetCurrentThreadId ()];
-          size_t   out_len       =         streaming_memory::data_len [GetCurrentThreadId ()];
-          size_t   offset        = 0;
-          size_t   decomp_size   = 0;
-
-          SzArEx_Extract ( &arc,          &look_stream.s, fileno,
-                           &block_idx,    &out,           &out_len,
-                           &offset,       &decomp_size,
-                           &thread_alloc, &thread_tmp_alloc );
-
-          if (streamed && size > (32 * 1024))
-            ReleaseSemaphore (decomp_semaphore, 1, nullptr);
-
-          wait = false;
-
-          load->pSrcData    = (Byte *)streaming_memory::data [GetCurrentThreadId ()] + offset;
-          load->SrcDataSize = decomp_size;
-
-          D3DXGetImageInfoFromFileInMemory (
-            load->pSrcData,
-              load->SrcDataSize,
-                &img_info );
-
-          hr = D3DXCreateTextureFromFileInMemoryEx_Original (
-            load->pDevice,
-              load->pSrcData, load->SrcDataSize,
-                img_info.Width, img_info.Height, img_info.MipLevels,
-                  0, img_info.Format,
-                    D3DPOOL_DEFAULT,
-                      D3DX_DEFAULT, D3DX_DEFAULT,
-                        0,
-                          &img_info, nullptr,
-                            &load->pSrc );
-        } break;
-
-        default:
-          tex_log->Log ( L"[  Tex. Mgr  ] Unexpected Wait Status: %X (crc32=%x)",
-                           dwResult,
-                             load->checksum );
-          wait = false;
-          break; 
-        }
+        ++visits_;
       }
 
-      load->pSrcData = nullptr;
+      if (used.size () > MAX_SCENE)
+        used.resize (MAX_SCENE);
+
+      scenes_ [scene_].swap (used);
     }
 
-    File_Close  (&arc_stream.file);
-    SzArEx_Free (&arc, &thread_alloc);
+    seen_.clear      ();
+    predicted_.clear ();
   }
 
-  if (streamed && size > (32 * 1024)) {
-    SetThreadPriority ( GetCurrentThread (),
-                          THREAD_MODE_BACKGROUND_END );
-  }
+private:
+  static const size_t MIN_SCENE =    8;
+  static const size_t MAX_SCENE = 4096;
 
-  return hr;
+  std::unordered_map <std::string, std::vector <uint32_t>> scenes_;
+
+  std::string          scene_;     // Last PAC loaded
+  std::set <uint32_t>  seen_;      // Requested or drawn since
+  std::set <uint32_t>  predicted_; // For it, when it loaded
+
+  ULONG                visits_          = 0UL;
+  ULONG                hits_            = 0UL;
+  ULONG                predicted_total_ = 0UL;
+  ULONG                used_total_      = 0UL;
+
+  bool                 active_          = false;
+  volatile LONG        visit_id_        = 0L;  // Bumped for every PAC
+  CRITICAL_SECTION     cs_scene;
+
+  // Render thread only: already in seen_ for visit bound_visit_
+  std::set <uint32_t>  bound_;
+  LONG                 bound_visit_     = 0L;
+} scene_predictor;
+
+void
+TSFix_PredictScene (const char* szName)
+{
+  scene_predictor.notePAC (szName);
 }
 
 DWORD
@@ -1879,12 +6061,95 @@ TextureResampleThread (LPVOID user)
   return 0;
 }
 
+ULONG completion_overruns = 0UL;
+
+ULONG  staged_upload_count = 0UL;
+UInt64 staged_upload_bytes = 0ULL;
+size_t staged_upload_last  = 0;   // Bytes, the frame before
+
+// Render thread: moves a staged load's texture into D3DPOOL_DEFAULT
+void
+TSFix_UploadStaged (tsf_tex_load_s* load)
+{
+  load->staged = false;
+
+  // Nobody wants it anymore, skip the upload
+  if (TSFix_LoadCancelled (load)) {
+    load->pSrc->Release ();
+    load->pSrc = nullptr;
+
+    return;
+  }
+
+  if (FAILED (TSFix_PromoteShadow (load))) {
+    tex_log->Log ( L"[Inject Tex]  ** Cannot upload texture %08x",
+                     load->checksum );
+  }
+}
+
+//
+// Attaches the small mips of an override that is still loading; the full
+//   chain replaces them like any other reload of its mip levels.
+//
 void
-TSFix_LoadQueuedTextures (void)
+TSFix_InstallPreview (tsf_tex_load_s* preview)
+{
+  ISKTextureD3D9* pSKTex =
+    (ISKTextureD3D9 *)preview->pDest;
+
+  // Only its job's reference is left, or something else got there first
+  if (TSFix_Unreferenced (pSKTex) || pSKTex->pTexOverride != nullptr) {
+    preview->pSrc->Release ();
+    return;
+  }
+
+  size_t vram_size =
+    SK_D3D9_TextureFootprint (preview->pSrc);
+
+  tex_log->Log ( L"[Inject Tex] Showing texture %08x without its top %lu mip levels "
+                 L"until it finishes loading",
+                   preview->checksum,
+                     preview->skip_mips );
+
+  QueryPerformanceCounter_Original (&pSKTex->last_used);
+
+  TSFix_InstallOverride (pSKTex, preview, vram_size);
+
+  InterlockedIncrement   (&preview_loads);
+  InterlockedExchangeAdd (&preview_bytes, (LONG)(vram_size / 1024));
+}
+
+//
+// Completes finished loads until budget_us is used up (0 = no limit), the
+//   remainder is carried over to the next frame. The budget is per-frame,
+//     not per-call, since this also runs from EndScene.
+//
+void
+TSFix_CompleteQueuedTextures (int budget_us)
 {
   extern std::string mod_text;
   mod_text = "";
 
+  static LARGE_INTEGER freq = { 0LL };
+
+  if (freq.QuadPart == 0LL)
+    QueryPerformanceFrequency (&freq);
+
+  static int      last_frame = -1;
+  static LONGLONG spent      = 0LL;
+
+  if (last_frame != tsf::RenderFix::draw_state.frames) {
+    last_frame = tsf::RenderFix::draw_state.frames;
+    spent      = 0LL;
+  }
+
+  const LONGLONG budget =
+    budget_us > 0 ? (LONGLONG)budget_us * freq.QuadPart / 1000000LL :
+                    std::numeric_limits <LONGLONG>::max ();
+
+  LARGE_INTEGER start, now;
+  QueryPerformanceCounter_Original (&start);
+
   static DWORD         dwTime = timeGetTime ();
   static unsigned char spin    = 193;
 
@@ -1934,13 +6199,53 @@ TSFix_LoadQueuedTextures (void)
 
   int loads = 0;
 
-  std::vector <tsf_tex_load_s *> finished;
+  stream_pool.cancelDead ();
 
-  finished = stream_pool.getFinished ();
+  stream_pool.getFinished (finished_loads);
 
-  for (auto it = finished.begin (); it != finished.end (); it++) {
+  if (reset_shadows.pending ()) {
+    QueryPerformanceCounter_Original (&now);
+
+    reset_shadows.restore ( std::max (0LL, budget - spent - (now.QuadPart - start.QuadPart)),
+                              spent == 0LL,
+                                finished_loads );
+  }
+
+  now = start;
+
+  // The first call each frame always completes at least one load, or a
+  //   single slow load could starve the queue forever.
+  const bool first_call = (spent == 0LL);
+
+  while ( (! finished_loads.empty ()) &&
+          ( (first_call && loads == 0) ||
+             spent + (now.QuadPart - start.QuadPart) < budget ) ) {
     tsf_tex_load_s* load =
-      *it;
+      finished_loads.pop_front ();
+
+    // Uploaded at the end of a frame, unless something is blocked on it
+    if (load->staged && load->pSrc != nullptr) {
+      if ( load->priority != PriorityBlocking &&
+           (! ((ISKTextureD3D9 *)load->pDest)->must_block) ) {
+        staged_uploads.push_back (load);
+        continue;
+      }
+
+      TSFix_UploadStaged (load);
+    }
+
+    // Never in-flight itself, nothing else can be looking at it
+    if (load->type == tsf_tex_load_s::Preview) {
+      TSFix_InstallPreview (load);
+
+      load_pool.free (load);
+
+      ++loads;
+
+      QueryPerformanceCounter_Original (&now);
+
+      continue;
+    }
 
     if (true) {
       tex_log->Log ( L"[%s] Finished %s texture %08x (%5.2f MiB in %9.4f ms)",
@@ -1967,48 +6272,453 @@ TSFix_LoadQueuedTextures (void)
     ISKTextureD3D9* pSKTex =
       (ISKTextureD3D9 *)load->pDest;
 
-    if (pSKTex->refs == 0 && load->pSrc != nullptr) {
+    // Requests for the same texture that arrived while this was in-flight
+    ISKTextureD3D9* waiters =
+      in_flight.finish (load);
+
+    // The original is gone, give the load to someone still waiting for it
+    while (TSFix_Unreferenced (pSKTex) && waiters != nullptr) {
+      pSKTex->Release ();
+
+      pSKTex  = waiters;
+      waiters = waiters->next_waiter;
+
+      pSKTex->next_waiter = nullptr;
+      load->pDest         = pSKTex;
+    }
+
+    size_t vram_size =
+      SK_D3D9_TextureFootprint (load->pSrc);
+
+    // The only remaining reference is the one the stream pool added (and
+    //   the cache's, which asks for the override again on its next hit)
+    if (TSFix_Unreferenced (pSKTex) && load->pSrc != nullptr) {
       tex_log->Log (L"[ Tex. Mgr ] >> Original texture no longer referenced, discarding new one!");
       load->pSrc->Release ();
-    } else {
+    }
+
+    // A different set of mip levels for an override that is resident already;
+    //   if the reload failed, keep what we have.
+    else if (pSKTex->pTexOverride != nullptr) {
+      if (load->pSrc != nullptr) {
+        IDirect3DTexture9* pOld     = pSKTex->pTexOverride;
+        SSIZE_T            old_size = pSKTex->override_size;
+
+        tsf::RenderFix::tex_mgr.removeInjected (pSKTex);
+        TSFix_DetachSharedOverride             (pSKTex);
+
+        pSKTex->pTexOverride = nullptr;
+        pOld->Release ();
+
+        TSFix_InstallOverride (pSKTex, load, vram_size);
+
+        ram_cache.setResident (load->checksum, true);
+
+        if (load->skip_mips > 0)
+          tsf::RenderFix::tex_mgr.noteDowngrade (old_size - (SSIZE_T)vram_size);
+      }
+    }
+
+    // Something attached after it was cancelled, start over for that
+    else if (load->cancelled) {
+      if (! TSFix_Unreferenced (pSKTex))
+        TSFix_ReloadOverride (pSKTex, load->skip_mips, load->priority);
+    }
+
+    // Keep drawing the original, and stop anything that blocks on this
+    else if (load->pSrc == nullptr) {
+      tex_log->Log ( L"[Inject Tex] >> Texture %08x failed to load, keeping the original",
+                       load->checksum );
+
+      pSKTex->must_block = false;
+    }
+
+    else {
       QueryPerformanceCounter_Original (&pSKTex->last_used);
 
-      pSKTex->pTexOverride  = load->pSrc;
-      pSKTex->override_size = load->SrcDataSize;
+      TSFix_InstallOverride (pSKTex, load, vram_size);
 
-      tsf::RenderFix::tex_mgr.addInjected (load->SrcDataSize);
+      ram_cache.setResident (load->checksum, true);
     }
 
-    finished_streaming (load->checksum);
+    // Shadows are for restoring full resolution after a Reset
+    if (load->pShadow != nullptr && load->skip_mips > 0) {
+      load->pShadow->Release ();
+      load->pShadow = nullptr;
+    }
 
-    tsf::RenderFix::tex_mgr.updateOSD ();
+    if (load->pShadow != nullptr) {
+      reset_shadows.store ( load->checksum,
+                              load->pShadow,
+                                vram_size,
+                                  pSKTex->last_used.QuadPart );
+    }
+
+    TSFix_ServeWaiters (pSKTex, waiters, load->pSrc != nullptr || load->cancelled);
+
+    // Remove the temporary reference added by the stream pool
+    pSKTex->Release ();
 
     ++loads;
 
-    delete load;
-  }
+    in_flight.retire (load);
+
+    QueryPerformanceCounter_Original (&now);
+  }
+
+  spent += (now.QuadPart - start.QuadPart);
+
+  in_flight.collect ();
+
+  if (loads > 0)
+    tsf::RenderFix::tex_mgr.updateOSD ();
+
+  if (loads > 0 && spent > budget) {
+    ++completion_overruns;
+
+    tex_log->Log ( L"[Perf Stats] Texture completion exceeded frame budget: "
+                   L"%7.3f ms / %7.3f ms  (%lu completed, %lu carried over)",
+                     1000.0 * (double)spent  / (double)freq.QuadPart,
+                     1000.0 * (double)budget / (double)freq.QuadPart,
+                       loads,
+                         finished_loads.size () );
+  }
+
+  if (! finished_loads.empty ()) {
+    char szFormatted [64];
+    sprintf (szFormatted, " (%lu awaiting completion)", finished_loads.size ());
+
+    mod_text += szFormatted;
+  }
+
+  //
+  // If the size changes, check to see if we need a purge - if so, schedule one.
+  //
+  static uint64_t last_size = 0ULL;
+
+  if (last_size != tsf::RenderFix::tex_mgr.cacheSizeTotal () ) {
+    last_size = tsf::RenderFix::tex_mgr.cacheSizeTotal ();
+
+    if ( last_size >
+           (1024ULL * 1024ULL) * (uint64_t)tsf::RenderFix::tex_mgr.cacheBudget () ||
+         tsf::RenderFix::tex_mgr.overQuota () )
+      __need_purge = true;
+  }
+
+  if ((! streaming) && (! resampling) && (! pending_loads ())) {
+    if (__need_purge) {
+      if (! tsf::RenderFix::tex_mgr.purging ())
+        tsf::RenderFix::tex_mgr.beginPurge ();
+
+      QueryPerformanceCounter_Original (&now);
+
+      LONGLONG remaining =
+        std::max (0LL, budget - spent - (now.QuadPart - start.QuadPart));
+
+      // Always make some progress, even if completion used up the budget
+      int slice_us =
+        budget_us > 0 ? std::max (100, (int)(remaining * 1000000LL / freq.QuadPart)) :
+                        0;
+
+      if (tsf::RenderFix::tex_mgr.purgeSlice (slice_us))
+        __need_purge = false;
+    }
+  }
+}
+
+void
+TSFix_LoadQueuedTextures (void)
+{
+  // Nobody minds a few slow frames on a loading screen
+  TSFix_CompleteQueuedTextures ( load_phase.loading () ? 0 :
+                                   config.textures.completion_us );
+}
+
+//
+// Uploads staged loads within the per-frame budget, those drawn during the
+//   frame that just ended first, and hands them to the completion. Runs at
+//     the end of a frame, so the uploads do not land in the middle of one.
+//
+void
+TSFix_UploadStagedTextures (void)
+{
+  static LARGE_INTEGER freq       = { 0LL };
+  static LONGLONG      last_frame = 0LL;
+
+  if (freq.QuadPart == 0LL)
+    QueryPerformanceFrequency (&freq);
+
+  LARGE_INTEGER start, now;
+  QueryPerformanceCounter_Original (&start);
+
+  const LONGLONG frame_start = last_frame;
+  last_frame                 = start.QuadPart;
+
+  staged_upload_last = 0;
+
+  if (staged_uploads.empty ())
+    return;
+
+  const LONGLONG max_ticks =
+    (LONGLONG)config.textures.upload_us * freq.QuadPart / 1000000LL;
+  const size_t   max_bytes =
+    (size_t)std::max (0, config.textures.upload_kib) * 1024;
+
+  size_t bytes   = 0;
+  int    uploads = 0;
+
+  now = start;
+
+  for (int pass = 0; pass < 2; pass++) {
+    SK_LoadList later;
+
+    while (! staged_uploads.empty ()) {
+      tsf_tex_load_s* load =
+        staged_uploads.pop_front ();
+
+      const bool bound =
+        ((ISKTextureD3D9 *)load->pDest)->last_used.QuadPart >= frame_start;
+
+      const size_t size =
+        SK_D3D9_TextureFootprint (load->pSrc);
+
+      // At least one per frame, or a single large texture could wait forever
+      const bool fits =
+        uploads == 0 || load_phase.loading () ||
+                        ( bytes + size                 <= max_bytes &&
+                          now.QuadPart - start.QuadPart < max_ticks );
+
+      if ((pass == 0 && (! bound)) || (! fits)) {
+        later.push_back (load);
+        continue;
+      }
+
+      TSFix_UploadStaged (load);
+
+      finished_loads.push_back (load);
+
+      bytes += size;
+      ++uploads;
+
+      QueryPerformanceCounter_Original (&now);
+    }
+
+    std::swap (staged_uploads, later);
+  }
+
+  staged_upload_last   = bytes;
+  staged_upload_bytes += bytes;
+  staged_upload_count += uploads;
+}
+
+
+//
+// Streams a resident override in again, with skip_mips top levels left out;
+//   the completion swaps it for the current one. Returns false if the
+//     texture is already in-flight, or has nothing to inject. A full
+//       resolution request joins a load that is in-flight already.
+//
+bool
+TSFix_ReloadOverride (ISKTextureD3D9* pSKTex, UINT skip_mips, tsf_tex_priority_t priority)
+{
+  const tsf_tex_record_s* inject =
+    tex_policy.injectable (pSKTex->tex_crc32);
+
+  if (inject == nullptr)
+    return false;
+
+  tsf_tex_load_s* load_op = load_pool.alloc ();
+
+  load_op->pDevice     = tsf::RenderFix::pDevice;
+  load_op->checksum    = pSKTex->tex_crc32;
+  load_op->type        = tsf_tex_load_s::Stream;
+  load_op->skip_mips   = skip_mips;
+  load_op->priority    = priority;
+  load_op->SrcDataSize = inject->size;
+  load_op->pDest       = pSKTex;
+
+  bool queued = false;
+
+  if (in_flight.acquire (load_op, skip_mips == 0 ? pSKTex : nullptr)) {
+    stream_pool.postJob (load_op);
+
+    queued = true;
+  }
+
+  else {
+    queued = (skip_mips == 0);
+
+    load_pool.free (load_op);
+  }
+
+  return queued;
+}
+
+//
+// Gives everything that attached itself to a finished load the override it
+//   produced; identical contents, so each one is just another user of it.
+//
+void
+TSFix_ServeWaiters (ISKTextureD3D9* pSKTex, ISKTextureD3D9* waiters, bool loaded)
+{
+  while (waiters != nullptr) {
+    ISKTextureD3D9* pWaiter = waiters;
+    waiters                 = waiters->next_waiter;
+
+    pWaiter->next_waiter = nullptr;
+
+    if ((! TSFix_Unreferenced (pWaiter)) && pWaiter->pTexOverride == nullptr) {
+      QueryPerformanceCounter_Original (&pWaiter->last_used);
+
+      // Not shareable (reduced mip levels or unknown contents), load its own
+      if (! TSFix_AttachSharedOverride (pWaiter, pSKTex->override_hash) && loaded)
+        TSFix_ReloadOverride (pWaiter, 0, PriorityStreaming);
+    }
+
+    // Remove the reference added when it attached
+    pWaiter->Release ();
+  }
+}
+
+// A staged load for checksum is needed before the frame ends
+void
+TSFix_UploadNow (uint32_t checksum)
+{
+  for ( tsf_tex_load_s* load  = staged_uploads.front ();
+                        load != nullptr;
+                        load  = load->next ) {
+    if (load->checksum != checksum)
+      continue;
+
+    staged_uploads.remove (load);
+
+    TSFix_UploadStaged (load);
+
+    finished_loads.push_front (load);
+
+    return;
+  }
+}
+
+//
+// A blocking texture was bound before its override arrived: run the load
+//   right here if no worker has started it, otherwise sleep until the worker
+//     is done, then complete it. Render thread only.
+//
+void
+TSFix_BlockOnLoad (ISKTextureD3D9* pSKTex)
+{
+  LARGE_INTEGER freq, start, end;
+
+  QueryPerformanceFrequency        (&freq);
+  QueryPerformanceCounter_Original (&start);
+
+  const wchar_t* wszHow = L"completed";
+
+  tsf_tex_load_s* load =
+    in_flight.peek (pSKTex->tex_crc32);
+
+  if (load != nullptr) {
+    // No preview on this path, the full chain is created right after the
+    //   decode on this same thread, so it would not end the stall sooner.
+    if (stream_pool.claimJob (load)) {
+      stream_pool.runJob (load);
+
+      wszHow = L"loaded inline";
+    }
+
+    else if (load->stage == tsf_tex_load_s::Running) {
+      HANDLE hDone =
+        CreateEvent (nullptr, TRUE, FALSE, nullptr);
+
+      // If it is waiting in a later stage, or for its read, it goes first there
+      stream_pool.hurry        (load);
+      SK_TextureArchive::hurry (load);
+
+      // Finished in the meantime otherwise
+      if ( InterlockedCompareExchangePointer ( &load->done,
+                                                 hDone,
+                                                   nullptr ) == nullptr )
+        WaitForSingleObject (hDone, INFINITE);
+
+      CloseHandle (hDone);
+
+      wszHow = L"waited for worker";
+    }
+  }
+
+  //
+  //   Not subject to the per-frame completion budget, the frame cannot
+  //     end (and replenish it) until this texture is ready.
+  //
+  while ( pSKTex->must_block && pSKTex->pTexOverride == nullptr ) {
+    TSFix_UploadNow              (pSKTex->tex_crc32);
+    TSFix_CompleteQueuedTextures (0);
+
+    // Nothing left that could give it an override
+    if (! is_streaming (pSKTex->tex_crc32))
+      break;
+  }
+
+  if (pSKTex->override_lod > 0 && is_streaming (pSKTex->tex_crc32))
+    wszHow = L"preview shown";
+
+  QueryPerformanceCounter_Original (&end);
+
+  tex_log->Log ( L"[Inject Tex] Bind of blocking texture %08x stalled for %7.3f ms (%s)",
+                   pSKTex->tex_crc32,
+                     1000.0 * (double)(end.QuadPart - start.QuadPart) /
+                              (double)freq.QuadPart,
+                       wszHow );
+}
+
+// A streaming texture is drawn without its override; it is needed right now
+void
+TSFix_PromoteLoad (ISKTextureD3D9* pSKTex)
+{
+  if (stream_pool.queueLength () == 0)
+    return;
+
+  tsf_tex_load_s* load =
+    in_flight.peek (pSKTex->tex_crc32);
+
+  if (load != nullptr && load->priority > PriorityVisible)
+    stream_pool.promote (load, PriorityVisible);
+}
+
+//
+// How many top mip levels a cold override can lose under memory pressure;
+//   only large (>= 2048) overrides qualify, and never below 1024.
+//
+UINT
+TSFix_MipsToDrop (ISKTextureD3D9* pSKTex)
+{
+  if ( config.textures.max_mip_drop <= 0 ||
+       pSKTex->pTexOverride == nullptr   ||
+       pSKTex->override_lod != 0         ||
+       pSKTex->must_block                ||
+       pSKTex->partition == tsf::RenderFix::PartitionFont || // Reloads would skip font.dds
+       TSFix_IsSharedOverride (pSKTex) ) // Would no longer be shared
+    return 0;
+
+  D3DSURFACE_DESC desc;
 
-  //
-  // If the size changes, check to see if we need a purge - if so, schedule one.
-  //
-  static uint64_t last_size = 0ULL;
+  if (FAILED (pSKTex->pTexOverride->GetLevelDesc (0, &desc)))
+    return 0;
 
-  if (last_size != tsf::RenderFix::tex_mgr.cacheSizeTotal () ) {
-    last_size = tsf::RenderFix::tex_mgr.cacheSizeTotal ();
+  UINT dim    = std::max (desc.Width, desc.Height);
+  UINT levels = pSKTex->pTexOverride->GetLevelCount ();
+  UINT skip   = 0;
 
-    if ( last_size >
-           (1024ULL * 1024ULL) * (uint64_t)config.textures.max_cache_in_mib )
-      __need_purge = true;
-  }
+  while ( skip     <  (UINT)config.textures.max_mip_drop &&
+          skip + 1 <  levels                             &&
+          (dim >> skip) >= 2048 )
+    ++skip;
 
-  if ((! streaming) && (! resampling) && (! pending_loads ())) {
-    if (__need_purge) {
-      tsf::RenderFix::tex_mgr.purge ();
-      __need_purge = false;
-    }
-  }
+  return skip;
 }
 
+
 COM_DECLSPEC_NOTHROW
 HRESULT
 STDMETHODCALLTYPE
@@ -2030,16 +6740,7 @@ D3DXCreateTextureFromFileInMemoryEx_Detour (
   _Out_   LPDIRECT3DTEXTURE9 *ppTexture
 )
 {
-  bool inject_thread = false;
-
-  EnterCriticalSection (&cs_tex_inject);
-
-  if (inject_tids.count (GetCurrentThreadId ())) {
-    inject_thread = true;
-    //resample      = false;
-  }
-
-  LeaveCriticalSection (&cs_tex_inject);
+  bool inject_thread = injecting;
 
   // Injection would recurse slightly and cause impossible to diagnose reference counting problems
   //   with texture caching if we did not check for this!
@@ -2075,12 +6776,27 @@ D3DXCreateTextureFromFileInMemoryEx_Detour (
 
   if (config.textures.cache && checksum != 0x00) {
     tsf::RenderFix::Texture* pTex =
-      tsf::RenderFix::tex_mgr.getTexture (checksum);
+      tsf::RenderFix::tex_mgr.acquireTexture (checksum);
 
     if (pTex != nullptr) {
       tsf::RenderFix::tex_mgr.refTexture (pTex);
 
-      *ppTexture = pTex->d3d9_tex;
+      ISKTextureD3D9* pSKTex = pTex->d3d9_tex;
+
+      // Its load was cancelled while only the cache kept it, ask again
+      if (pSKTex->pTexOverride == nullptr && (! is_streaming (checksum))) {
+        TSFix_ReloadOverride ( pSKTex, 0,
+                                 pSKTex->must_block ? PriorityBlocking :
+                                                      PriorityStreaming );
+      }
+
+      *ppTexture = pSKTex;
+
+      QueryPerformanceCounter_Original (&end);
+
+      tsf::RenderFix::tex_mgr.recordHitTime (
+        (end.QuadPart - start.QuadPart) * 1000000000LL / freq.QuadPart
+      );
 
       return S_OK;
     }
@@ -2088,10 +6804,17 @@ D3DXCreateTextureFromFileInMemoryEx_Detour (
 
   bool resample = false;
 
+  const tsf_tex_policy_s* policy =
+    tex_policy.find (checksum);
+
+  const uint32_t policy_flags =
+    policy != nullptr ? policy->flags : 0x0;
+
+  const bool dumpable =
+    (! (policy_flags & (TSFix_PolicyDumped | TSFix_PolicyInject)));
+
   // Necessary to make D3DX texture write functions work
-  if ( Pool == D3DPOOL_DEFAULT && config.textures.dump &&
-        (! dumped_textures.count     (checksum))           &&
-        (! injectable_textures.count (checksum)) )
+  if ( Pool == D3DPOOL_DEFAULT && config.textures.dump && dumpable )
     Usage = D3DUSAGE_DYNAMIC;
 
   // Generate complete mipmap chains for best image quality
@@ -2103,8 +6826,6 @@ D3DXCreateTextureFromFileInMemoryEx_Detour (
   HRESULT         hr           = E_FAIL;
   tsf_tex_load_s* load_op      = nullptr;
 
-  wchar_t wszInjectFileName [MAX_PATH] = { L'\0' };
-
   bool remap_stream = is_streaming (checksum);
 
   //
@@ -2115,13 +6836,12 @@ D3DXCreateTextureFromFileInMemoryEx_Detour (
          GetFileAttributes (L"font.dds") != INVALID_FILE_ATTRIBUTES ) {
     tex_log->LogEx (true, L"[   Font   ] Loading user-defined font... ");
 
-    load_op           = new tsf_tex_load_s;
-    load_op->pDevice  = pDevice;
-    load_op->checksum = checksum;
-
-    load_op->type     = tsf_tex_load_s::Stream;
+    load_op            = load_pool.alloc ();
+    load_op->pDevice   = pDevice;
+    load_op->checksum  = checksum;
+    load_op->user_font = true;
 
-    wcscpy (load_op->wszFilename, L"font.dds");
+    load_op->type      = tsf_tex_load_s::Stream;
 
     if (load_op->type == tsf_tex_load_s::Stream) {
       if (! remap_stream)
@@ -2134,33 +6854,20 @@ D3DXCreateTextureFromFileInMemoryEx_Detour (
   //
   // Generic injectable textures
   //
-  else if ( (! inject_thread) &&
-            injectable_textures.find (checksum) !=
-                     injectable_textures.end () )
+  else if ( (! inject_thread) && (policy_flags & TSFix_PolicyInject) )
   {
     tex_log->LogEx ( true, L"[Inject Tex] Injectable texture for checksum (%08x)... ",
                       checksum );
 
-    tsf_tex_record_s record = injectable_textures [checksum];
+    tsf_tex_record_s record = policy->record;
 
     if (record.method == DontCare)
       record.method = Streaming;
 
-    // If -1, load from disk...
-    if (record.archive == -1) {
-      if (record.method == Streaming)
-        _swprintf ( wszInjectFileName, L"%s\\inject\\textures\\streaming\\%08x%s",
-                      TSFIX_TEXTURE_DIR,
-                        checksum,
-                          TSFIX_TEXTURE_EXT );
-      else if (record.method == Blocking)
-        _swprintf ( wszInjectFileName, L"%s\\inject\\textures\\blocking\\%08x%s",
-                      TSFIX_TEXTURE_DIR,
-                        checksum,
-                          TSFIX_TEXTURE_EXT );
-    }
-
-    load_op           = new tsf_tex_load_s;
+    idle_prefetch.noteRequest   (checksum);
+    scene_predictor.noteRequest (checksum);
+
+    load_op           = load_pool.alloc ();
     load_op->pDevice  = pDevice;
     load_op->checksum = checksum;
 
@@ -2169,7 +6876,9 @@ D3DXCreateTextureFromFileInMemoryEx_Detour (
     else
       load_op->type   = tsf_tex_load_s::Immediate;
 
-    wcscpy (load_op->wszFilename, wszInjectFileName);
+    load_op->priority =
+      load_op->type == tsf_tex_load_s::Immediate ? PriorityBlocking :
+                                                   PriorityStreaming;
 
     if (load_op->type == tsf_tex_load_s::Stream) {
       if ((! remap_stream))
@@ -2192,242 +6901,598 @@ D3DXCreateTextureFromFileInMemoryEx_Detour (
                                                                ppTexture );
 
   if (SUCCEEDED (hr)) {
-    new ISKTextureD3D9 (ppTexture, SrcDataSize, checksum);
+    new ISKTextureD3D9 (ppTexture, SK_D3D9_TextureFootprint (*ppTexture), checksum);
+
+    ((ISKTextureD3D9 *)*ppTexture)->partition =
+      tsf::RenderFix::tex_mgr.classifyTexture (checksum, policy);
+
+    // Identical to an override that is resident already, share that one
+    //   instead of loading another copy.
+    if ( load_op != nullptr && (! remap_stream) &&
+         TSFix_AttachSharedOverride ( (ISKTextureD3D9 *)*ppTexture,
+                                        TSFix_ContentHash (checksum) ) ) {
+      tex_log->Log ( L"[Inject Tex] Texture %08x is identical to a resident "
+                     L"override, sharing it", checksum );
+
+      load_pool.free (load_op);
+      load_op = nullptr;
+    }
 
     if ( load_op != nullptr && ( load_op->type == tsf_tex_load_s::Stream ||
                                  load_op->type == tsf_tex_load_s::Immediate ) ) {
+      // The user-defined font may have no record
       load_op->SrcDataSize =
-        injectable_textures [checksum].size;
+        policy != nullptr ? (UINT)policy->record.size : 0;
 
       load_op->pDest = *ppTexture;
-      EnterCriticalSection        (&cs_tex_stream);
-      {
-        if (load_op->type == tsf_tex_load_s::Immediate)
-          ((ISKTextureD3D9 *)*ppTexture)->must_block = true;
-
-        if (is_streaming (load_op->checksum)) {
-          ISKTextureD3D9* pTexOrig =
-            (ISKTextureD3D9 *)textures_in_flight [load_op->checksum]->pDest;
-
-          // Remap the output of the in-flight texture
-          textures_in_flight [load_op->checksum]->pDest =
-            *ppTexture;
-
-          if (tsf::RenderFix::tex_mgr.getTexture (load_op->checksum)  != nullptr) {
-            for ( int i = 0;
-                      i < tsf::RenderFix::tex_mgr.getTexture (load_op->checksum)->refs;
-                    ++i ) {
-              (*ppTexture)->AddRef ();
-            }
-          }
 
-          ////tsf::RenderFix::tex_mgr.removeTexture (pTexOrig);
-        }
+      if (load_op->type == tsf_tex_load_s::Immediate)
+        ((ISKTextureD3D9 *)*ppTexture)->must_block = true;
+
+      // Already in-flight: this texture gets the same override when it is done
+      if (! in_flight.acquire (load_op, (ISKTextureD3D9 *)*ppTexture)) {
+        load_pool.free (load_op);
+        load_op = nullptr;
+      }
+
+      // Uploading a system memory shadow is far cheaper than reading
+      //   and decompressing the texture all over again.
+      else if (! reset_shadows.requestRestore (load_op))
+        stream_pool.postJob (load_op);
+    }
+
+#if 0
+    //
+    // TODO:  Actually stream these, but block if the game tries to call SetTexture (...)
+    //          while the texture is in-flight.
+    //
+    else if (load_op != nullptr && load_op->type == tsf_tex_load_s::Immediate) {
+      QueryPerformanceFrequency        (&load_op->freq);
+      QueryPerformanceCounter_Original (&load_op->start);
+
+      start_load ();
+
+      load_op->pDest = *ppTexture;
+
+      hr = InjectTexture (load_op);
+
+      end_load ();
+
+      QueryPerformanceCounter_Original (&load_op->end);
+
+      if (SUCCEEDED (hr)) {
+        tex_log->Log ( L"[Inject Tex] Finished synchronous texture %08x (%5.2f MiB in %9.4f ms)",
+                        load_op->checksum,
+                          (double)load_op->SrcDataSize / (1024.0f * 1024.0f),
+                            1000.0f * (double)(load_op->end.QuadPart - load_op->start.QuadPart) /
+                                      (double) load_op->freq.QuadPart );
+        ISKTextureD3D9* pSKTex =
+          (ISKTextureD3D9 *)*ppTexture;
+
+        pSKTex->pTexOverride  = load_op->pSrc;
+        pSKTex->override_size = SK_D3D9_TextureFootprint (load_op->pSrc);
+
+        pSKTex->last_used     = load_op->end;
+
+        tsf::RenderFix::tex_mgr.addInjected (pSKTex);
+      } else {
+        tex_log->Log ( L"[Inject Tex] *** FAILED synchronous texture %08x",
+                         load_op->checksum );
+      }
+
+      delete load_op;
+      load_op = nullptr;
+    }
+#endif
+
+// Temporarily disabled while mipmap-related issues are debugged...
+#if 0
+    else if (resample) {
+      load_op              = new tsf_tex_load_s;
+      load_op->pDevice     = pDevice;
+      load_op->checksum    = checksum;
+      load_op->type        = tsf_tex_load_s::Resample;
+      load_op->pSrcData    = new uint8_t [SrcDataSize];
+      load_op->SrcDataSize = SrcDataSize;
+      memcpy (load_op->pSrcData, pSrcData, SrcDataSize);
+
+      load_op->pDest = *ppTexture;
+      load_op->pDest->AddRef (); // Don't delete this texture until we
+                                 //   load the real one!
+
+      EnterCriticalSection      (&cs_tex_resample);
+      textures_to_resample.push (load_op);
+      CreateThread              (nullptr, 0, TextureResampleThread, nullptr, 0, nullptr);
+      LeaveCriticalSection      (&cs_tex_resample);
+    }
+#endif
+  }
+
+  else if (load_op != nullptr) {
+    load_pool.free (load_op);
+    load_op = nullptr;
+  }
+
+  QueryPerformanceCounter_Original (&end);
+
+  if (SUCCEEDED (hr)) {
+    if (config.textures.cache && checksum != 0x00) {
+      tsf::RenderFix::Texture* pTex =
+        tsf::RenderFix::tex_mgr.allocTexture ();
+
+      pTex->crc32 = checksum;
+
+      pTex->d3d9_tex = *(ISKTextureD3D9 **)ppTexture;
+      pTex->d3d9_tex->AddRef ();
+      pTex->d3d9_tex->cached = true;
+      InterlockedIncrement (&pTex->refs);
+
+      pTex->load_time = 1000.0f * (float)(end.QuadPart - start.QuadPart) / (float)freq.QuadPart;
+
+      tsf::RenderFix::tex_mgr.addTexture (checksum, pTex, pTex->d3d9_tex->tex_size);
+    }
+
+    if (config.textures.log) {
+      tex_log->Log ( L"[Load Trace] Texture:   (%lu x %lu) * <LODs: %lu> - FAST_CRC32: %X",
+                       Width, Height, (*ppTexture)->GetLevelCount (), checksum );
+      tex_log->Log ( L"[Load Trace]              Usage: %-20s - Format: %-20s",
+                       SK_D3D9_UsageToStr    (Usage).c_str (),
+                         SK_D3D9_FormatToStr (Format).c_str () );
+      tex_log->Log ( L"[Load Trace]                Pool: %s",
+                       SK_D3D9_PoolToStr (Pool) );
+      tex_log->Log ( L"[Load Trace]      Load Time: %6.4f ms", 
+                     1000.0 * (double)(end.QuadPart - start.QuadPart) / (double)freq.QuadPart );
+    }
+  }
+
+  if ( config.textures.dump && (! inject_thread) && dumpable ) {
+    D3DXIMAGE_INFO info;
+    D3DXGetImageInfoFromFileInMemory (pSrcData, SrcDataSize, &info);
+
+    D3DFORMAT fmt_real = info.Format;
+
+    bool compressed = (fmt_real >= D3DFMT_DXT1 && fmt_real <= D3DFMT_DXT5);
+
+    wchar_t wszPath [MAX_PATH];
+    _swprintf ( wszPath, L"%s\\dump\\textures\\%s",
+                  TSFIX_TEXTURE_DIR, SK_D3D9_FormatToStr (fmt_real, false).c_str () );
+
+    if (GetFileAttributesW (wszPath) != FILE_ATTRIBUTE_DIRECTORY)
+      CreateDirectoryW (wszPath, nullptr);
+
+    wchar_t wszFileName [MAX_PATH] = { L'\0' };
+    _swprintf ( wszFileName, L"%s\\dump\\textures\\%s\\%08x%s",
+                  TSFIX_TEXTURE_DIR,
+                    SK_D3D9_FormatToStr (fmt_real, false).c_str (),
+                      checksum,
+                        TSFIX_TEXTURE_EXT );
+
+    D3DXSaveTextureToFile (wszFileName, D3DXIFF_DDS, (*ppTexture), NULL);
+  }
+
+  return hr;
+}
+
+
+std::vector <ISKTextureD3D9 *> remove_textures;
+
+//
+// Read-mostly index over the texture cache, so that a cache hit can be found
+//   without taking cs_cache. Writers (always holding cs_cache) publish a new
+//     table when this one fills up; readers probe whichever one they loaded.
+//
+//  * Removing an entry leaves a tombstone (checksum kept, texture cleared)
+//      that only the same checksum may reuse, so a slot never changes keys
+//        underneath a reader. Tombstones are dropped when the table grows.
+//
+//  * Tables and textures that readers may still be looking at are retired
+//      and only deleted once no reader is inside the index.
+//
+struct tsf_tex_index_s {
+  struct slot_s {
+    volatile LONG                     crc32;
+    tsf::RenderFix::Texture* volatile tex;
+  };
+
+  tsf_tex_index_s (ULONG capacity) {
+    mask  = capacity - 1;
+    used  = 0;
+    live  = 0;
+    slots = new slot_s [capacity];
+
+    memset (slots, 0, sizeof (slot_s) * capacity);
+  }
+
+  ~tsf_tex_index_s (void) {
+    delete [] slots;
+  }
+
+  ULONG   mask;
+  ULONG   used; // Live entries + tombstones
+  ULONG   live;
+  slot_s* slots;
+};
+
+tsf_tex_index_s* volatile      tex_index         = nullptr;
+volatile LONG                  tex_index_readers = 0L;
+
+std::vector <tsf_tex_index_s         *> retired_indices;
+std::vector <ISKTextureD3D9          *> retired_textures;
+std::vector <tsf::RenderFix::Texture *> retired_records;
+
+tsf::RenderFix::Texture*
+tex_index_find (tsf_tex_index_s* index, uint32_t checksum)
+{
+  ULONG slot = checksum & index->mask;
+
+  for (ULONG probes = 0; probes <= index->mask; ++probes) {
+    uint32_t crc32 = (uint32_t)index->slots [slot].crc32;
+
+    if (crc32 == checksum)
+      return index->slots [slot].tex;
+
+    if (crc32 == 0x00)
+      break;
+
+    slot = (slot + 1) & index->mask;
+  }
+
+  return nullptr;
+}
+
+// cs_cache must be held
+void
+tex_index_insert (uint32_t checksum, tsf::RenderFix::Texture* pTex)
+{
+  tsf_tex_index_s* index = tex_index;
+
+  // Keep the load factor (including tombstones) at or below 1/2
+  if ((index->used + 1) * 2 > index->mask + 1) {
+    ULONG capacity = index->mask + 1;
+
+    while ((index->live + 1) * 4 > capacity)
+      capacity *= 2;
+
+    tsf_tex_index_s* grown =
+      new tsf_tex_index_s (capacity);
+
+    for (ULONG i = 0; i <= index->mask; i++) {
+      if (index->slots [i].tex == nullptr)
+        continue;
+
+      uint32_t crc32 = (uint32_t)index->slots [i].crc32;
+      ULONG    slot  = crc32 & grown->mask;
+
+      while (grown->slots [slot].crc32 != 0)
+        slot = (slot + 1) & grown->mask;
+
+      grown->slots [slot].tex   = index->slots [i].tex;
+      grown->slots [slot].crc32 = crc32;
+
+      ++grown->used;
+      ++grown->live;
+    }
+
+    InterlockedExchangePointer ((PVOID volatile *)&tex_index, grown);
+
+    retired_indices.push_back (index);
+    index = grown;
+  }
+
+  ULONG slot = checksum & index->mask;
+
+  while ( index->slots [slot].crc32 != 0 &&
+          (uint32_t)index->slots [slot].crc32 != checksum )
+    slot = (slot + 1) & index->mask;
+
+  if (index->slots [slot].crc32 == 0) {
+    // Texture first, a reader that sees the checksum must also see this
+    index->slots [slot].tex = pTex;
+    InterlockedExchange (&index->slots [slot].crc32, (LONG)checksum);
+
+    ++index->used;
+    ++index->live;
+  }
+
+  else {
+    if (index->slots [slot].tex == nullptr)
+      ++index->live;
+
+    InterlockedExchangePointer ((PVOID volatile *)&index->slots [slot].tex, pTex);
+  }
+}
+
+// cs_cache must be held
+void
+tex_index_remove (uint32_t checksum, ISKTextureD3D9* pSKTex)
+{
+  tsf_tex_index_s* index = tex_index;
+
+  ULONG slot = checksum & index->mask;
+
+  for (ULONG probes = 0; probes <= index->mask; ++probes) {
+    uint32_t crc32 = (uint32_t)index->slots [slot].crc32;
+
+    if (crc32 == 0x00)
+      return;
+
+    if (crc32 == checksum) {
+      tsf::RenderFix::Texture* pTex =
+        index->slots [slot].tex;
+
+      // Only if it has not already been replaced by a newer texture
+      if (pTex != nullptr && pTex->d3d9_tex == pSKTex) {
+        InterlockedExchangePointer ((PVOID volatile *)&index->slots [slot].tex, nullptr);
+        --index->live;
+      }
+
+      return;
+    }
+
+    slot = (slot + 1) & index->mask;
+  }
+}
+
+//
+// No reference is added; the record is only safe to use until the next
+//   flushRemoves (...), which runs on the render thread. Other threads have
+//     to use acquireTexture (...).
+//
+tsf::RenderFix::Texture*
+tsf::RenderFix::TextureManager::getTexture (uint32_t checksum)
+{
+  tsf::RenderFix::Texture* pTex = nullptr;
+
+  if ( tsf::RenderFix::dwRenderThreadID != 0UL &&
+       tsf::RenderFix::dwRenderThreadID != GetCurrentThreadId () ) {
+    dll_log->Log ( L"[ Tex. Mgr ] getTexture (%08x) called from tid=%x, "
+                   L"which is not the render thread!",
+                     checksum,
+                       GetCurrentThreadId () );
+    return nullptr;
+  }
+
+  InterlockedIncrement (&tex_index_readers);
+
+  if (tex_index != nullptr)
+    pTex = tex_index_find (tex_index, checksum);
+
+  InterlockedDecrement (&tex_index_readers);
+
+  return pTex;
+}
+
+//
+// Cache-hit path: one probe and a reference that is only taken if the
+//   texture is still alive (a purge may have just dropped the last one).
+//
+tsf::RenderFix::Texture*
+tsf::RenderFix::TextureManager::acquireTexture (uint32_t checksum)
+{
+  tsf::RenderFix::Texture* pTex = nullptr;
+
+  InterlockedIncrement (&tex_index_readers);
+
+  if (tex_index != nullptr) {
+    pTex = tex_index_find (tex_index, checksum);
 
-        else {
-          textures_in_flight.insert ( std::make_pair ( load_op->checksum,
-                                       load_op ) );
+    if (pTex != nullptr && (! pTex->d3d9_tex->AddRefIfAlive ()))
+      pTex = nullptr;
+  }
 
-          stream_pool.postJob (load_op);
-        }
-      }
-      LeaveCriticalSection        (&cs_tex_stream);
-    }
+  InterlockedDecrement (&tex_index_readers);
 
-#if 0
-    //
-    // TODO:  Actually stream these, but block if the game tries to call SetTexture (...)
-    //          while the texture is in-flight.
-    //
-    else if (load_op != nullptr && load_op->type == tsf_tex_load_s::Immediate) {
-      QueryPerformanceFrequency        (&load_op->freq);
-      QueryPerformanceCounter_Original (&load_op->start);
+  return pTex;
+}
 
-      EnterCriticalSection (&cs_tex_inject);
-      inject_tids.insert   (GetCurrentThreadId ());
-      LeaveCriticalSection (&cs_tex_inject);
+//
+// Deferred from ISKTextureD3D9::Release (...); this is what actually frees
+//   textures. Runs on the render thread once per-frame, and before purges.
+//
+void
+tsf::RenderFix::TextureManager::flushRemoves (void)
+{
+  EnterCriticalSection (&cs_cache);
 
-      load_op->pDest = *ppTexture;
+  auto rem = remove_textures.begin ();
 
-      hr = InjectTexture (load_op);
+  while (rem != remove_textures.end ()) {
+    tex_partition_s& part =
+      partitions [(*rem)->partition];
 
-      EnterCriticalSection (&cs_tex_inject);
-      inject_tids.erase    (GetCurrentThreadId ());
-      LeaveCriticalSection (&cs_tex_inject);
+    if ((*rem)->pTexOverride != nullptr) {
+      removeInjected             (*rem);
+      TSFix_DetachSharedOverride (*rem);
 
-      QueryPerformanceCounter_Original (&load_op->end);
+      // Keep these around in RAM, now that they are gone from VRAM
+      ram_cache.setResident ((*rem)->tex_crc32, false);
+    }
 
-      if (SUCCEEDED (hr)) {
-        tex_log->Log ( L"[Inject Tex] Finished synchronous texture %08x (%5.2f MiB in %9.4f ms)",
-                        load_op->checksum,
-                          (double)load_op->SrcDataSize / (1024.0f * 1024.0f),
-                            1000.0f * (double)(load_op->end.QuadPart - load_op->start.QuadPart) /
-                                      (double) load_op->freq.QuadPart );
-        ISKTextureD3D9* pSKTex =
-          (ISKTextureD3D9 *)*ppTexture;
+    if ((*rem)->pTex)         (*rem)->pTex->Release         ();
+    if ((*rem)->pTexOverride) (*rem)->pTexOverride->Release ();
 
-        pSKTex->pTexOverride  = load_op->pSrc;
-        pSKTex->override_size = load_op->SrcDataSize;
+    (*rem)->pTex         = nullptr;
+    (*rem)->pTexOverride = nullptr;
 
-        pSKTex->last_used     = load_op->end;
+    InterlockedAdd64     (&basic_size,  -(*rem)->tex_size);
+    InterlockedAdd64     (&part.size,   -(*rem)->tex_size);
+    InterlockedDecrement (&part.count);
+    {
+      auto tex = textures.find ((*rem)->tex_crc32);
 
-        tsf::RenderFix::tex_mgr.addInjected (load_op->SrcDataSize);
-      } else {
-        tex_log->Log ( L"[Inject Tex] *** FAILED synchronous texture %08x",
-                         load_op->checksum );
+      // A newer texture with the same checksum may have replaced this one
+      if (tex != textures.end () && tex->second->d3d9_tex == *rem) {
+        retired_records.push_back (tex->second);
+        textures.erase            (tex);
       }
 
-      delete load_op;
-      load_op = nullptr;
+      tex_index_remove ((*rem)->tex_crc32, *rem);
     }
-#endif
-
-// Temporarily disabled while mipmap-related issues are debugged...
-#if 0
-    else if (resample) {
-      load_op              = new tsf_tex_load_s;
-      load_op->pDevice     = pDevice;
-      load_op->checksum    = checksum;
-      load_op->type        = tsf_tex_load_s::Resample;
-      load_op->pSrcData    = new uint8_t [SrcDataSize];
-      load_op->SrcDataSize = SrcDataSize;
-      memcpy (load_op->pSrcData, pSrcData, SrcDataSize);
-
-      load_op->pDest = *ppTexture;
-      load_op->pDest->AddRef (); // Don't delete this texture until we
-                                 //   load the real one!
 
-      EnterCriticalSection      (&cs_tex_resample);
-      textures_to_resample.push (load_op);
-      CreateThread              (nullptr, 0, TextureResampleThread, nullptr, 0, nullptr);
-      LeaveCriticalSection      (&cs_tex_resample);
-    }
-#endif
-  }
+    retired_textures.push_back (*rem);
 
-  else if (load_op != nullptr) {
-    delete load_op;
-    load_op = nullptr;
+    ++rem;
   }
 
-  QueryPerformanceCounter_Original (&end);
+  remove_textures.clear ();
 
-  if (SUCCEEDED (hr)) {
-    if (config.textures.cache && checksum != 0x00) {
-      tsf::RenderFix::Texture* pTex =
-        new tsf::RenderFix::Texture ();
+  // Nobody can find these anymore, but a reader that started before they
+  //   were unlinked may still be touching them.
+  if (tex_index_readers == 0) {
+    for (auto it : retired_textures)
+      delete it;
 
-      pTex->crc32 = checksum;
+    for (auto it : retired_indices)
+      delete it;
 
-      pTex->d3d9_tex = *(ISKTextureD3D9 **)ppTexture;
-      pTex->d3d9_tex->AddRef ();
-      pTex->refs++;
+    for (auto it : retired_records)
+      freeTexture (it);
 
-      pTex->load_time = 1000.0f * (float)(end.QuadPart - start.QuadPart) / (float)freq.QuadPart;
+    retired_textures.clear ();
+    retired_indices.clear  ();
+    retired_records.clear  ();
+  }
 
-      tsf::RenderFix::tex_mgr.addTexture (checksum, pTex, SrcDataSize);
-    }
+  LeaveCriticalSection (&cs_cache);
+}
 
-    if (config.textures.log) {
-      tex_log->Log ( L"[Load Trace] Texture:   (%lu x %lu) * <LODs: %lu> - FAST_CRC32: %X",
-                       Width, Height, (*ppTexture)->GetLevelCount (), checksum );
-      tex_log->Log ( L"[Load Trace]              Usage: %-20s - Format: %-20s",
-                       SK_D3D9_UsageToStr    (Usage).c_str (),
-                         SK_D3D9_FormatToStr (Format).c_str () );
-      tex_log->Log ( L"[Load Trace]                Pool: %s",
-                       SK_D3D9_PoolToStr (Pool) );
-      tex_log->Log ( L"[Load Trace]      Load Time: %6.4f ms", 
-                     1000.0 * (double)(end.QuadPart - start.QuadPart) / (double)freq.QuadPart );
-    }
-  }
+void
+tsf::RenderFix::TextureManager::addTexture (uint32_t checksum, tsf::RenderFix::Texture* pTex, size_t size)
+{
+  pTex->size = size;
 
-  if ( config.textures.dump && (! inject_thread) && (! injectable_textures.count (checksum)) &&
-                          (! dumped_textures.count (checksum)) ) {
-    D3DXIMAGE_INFO info;
-    D3DXGetImageInfoFromFileInMemory (pSrcData, SrcDataSize, &info);
+  InterlockedAdd64 (&basic_size, pTex->size);
 
-    D3DFORMAT fmt_real = info.Format;
+  tex_partition_s& part =
+    partitions [pTex->d3d9_tex->partition];
 
-    bool compressed = (fmt_real >= D3DFMT_DXT1 && fmt_real <= D3DFMT_DXT5);
+  InterlockedAdd64     (&part.size, pTex->size);
+  InterlockedIncrement (&part.count);
 
-    wchar_t wszPath [MAX_PATH];
-    _swprintf ( wszPath, L"%s\\dump\\textures\\%s",
-                  TSFIX_TEXTURE_DIR, SK_D3D9_FormatToStr (fmt_real, false).c_str () );
+  EnterCriticalSection (&cs_cache);
+  {
+    auto existing = textures.find (checksum);
 
-    if (GetFileAttributesW (wszPath) != FILE_ATTRIBUTE_DIRECTORY)
-      CreateDirectoryW (wszPath, nullptr);
+    // The record this replaces may still be in use by a lock-free reader
+    if (existing != textures.end () && existing->second != pTex)
+      retired_records.push_back (existing->second);
 
-    wchar_t wszFileName [MAX_PATH] = { L'\0' };
-    _swprintf ( wszFileName, L"%s\\dump\\textures\\%s\\%08x%s",
-                  TSFIX_TEXTURE_DIR,
-                    SK_D3D9_FormatToStr (fmt_real, false).c_str (),
-                      checksum,
-                        TSFIX_TEXTURE_EXT );
+    textures [checksum] = pTex;
 
-    D3DXSaveTextureToFile (wszFileName, D3DXIFF_DDS, (*ppTexture), NULL);
+    tex_index_insert (checksum, pTex);
   }
+  LeaveCriticalSection (&cs_cache);
 
-  return hr;
+  updateOSD ();
 }
 
-
-std::vector <ISKTextureD3D9 *> remove_textures;
-
 tsf::RenderFix::Texture*
-tsf::RenderFix::TextureManager::getTexture (uint32_t checksum)
+tsf::RenderFix::TextureManager::allocTexture (void)
 {
+  tsf::RenderFix::Texture* pTex = nullptr;
+
   EnterCriticalSection (&cs_cache);
+  {
+    uint32_t handle;
 
-    auto rem = remove_textures.begin ();
+    if (! free_records.empty ()) {
+      handle = free_records.back ();
+      free_records.pop_back ();
+    }
 
-    while (rem != remove_textures.end ()) {
-      if ((*rem)->pTexOverride != nullptr) {
-        InterlockedDecrement (&injected_count);
-        InterlockedAdd64     (&injected_size, -(*rem)->override_size);
-      }
+    else {
+      if (records_used == record_chunks.size () * record_chunk_size)
+        record_chunks.push_back (new tsf::RenderFix::Texture [record_chunk_size]);
 
-      if ((*rem)->pTex)         (*rem)->pTex->Release         ();
-      if ((*rem)->pTexOverride) (*rem)->pTexOverride->Release ();
+      handle = records_used++;
+    }
 
-      (*rem)->pTex         = nullptr;
-      (*rem)->pTexOverride = nullptr;
+    pTex = &record_chunks [handle / record_chunk_size][handle % record_chunk_size];
 
-      InterlockedAdd64 (&basic_size,  -(*rem)->tex_size);
-      {
-        textures.erase ((*rem)->tex_crc32);
-      }
+   *pTex        = tsf::RenderFix::Texture ();
+    pTex->handle = handle;
+  }
+  LeaveCriticalSection (&cs_cache);
 
-      delete *rem;
+  return pTex;
+}
 
-      ++rem;
-    }
+// cs_cache must be held, and no lock-free reader may still see pTex
+void
+tsf::RenderFix::TextureManager::freeTexture (tsf::RenderFix::Texture* pTex)
+{
+  pTex->d3d9_tex = nullptr;
 
-    remove_textures.clear ();
+  free_records.push_back (pTex->handle);
+}
 
-    auto tex = textures.find (checksum);
+void
+tsf::RenderFix::TextureManager::addInjected (ISKTextureD3D9* pSKTex)
+{
+  InterlockedIncrement (&injected_count);
+  InterlockedAdd64     (&injected_size, pSKTex->override_size);
 
-  LeaveCriticalSection (&cs_cache);
+  InterlockedAdd64     (&partitions [pSKTex->partition].size, pSKTex->override_size);
+}
 
-  if (tex != textures.end ())
-    return tex->second;
+void
+tsf::RenderFix::TextureManager::removeInjected (ISKTextureD3D9* pSKTex)
+{
+  InterlockedDecrement (&injected_count);
+  InterlockedAdd64     (&injected_size, -pSKTex->override_size);
 
-  return nullptr;
+  InterlockedAdd64     (&partitions [pSKTex->partition].size, -pSKTex->override_size);
 }
 
+// Moves the memory of a shared override to another of its users
 void
-tsf::RenderFix::TextureManager::addTexture (uint32_t checksum, tsf::RenderFix::Texture* pTex, size_t size)
+tsf::RenderFix::TextureManager::chargeInjected (ISKTextureD3D9* pSKTex, int64_t size)
 {
-  pTex->size = size;
+  InterlockedAdd64 (&injected_size, size);
 
-  InterlockedAdd64 (&basic_size, pTex->size);
+  InterlockedAdd64 (&partitions [pSKTex->partition].size, size);
+}
 
-  EnterCriticalSection (&cs_cache);
-  {
-    textures [checksum] = pTex;
+//
+// A downgrade has replaced its full chain, which is when it actually frees
+//   something; counted toward the purge that queued it, if still running.
+//
+void
+tsf::RenderFix::TextureManager::noteDowngrade (int64_t saved)
+{
+  if ((! purge_job.active) || saved <= 0LL)
+    return;
+
+  purge_job.reclaimed          += saved;
+  purge_job.reclaimed_injected += saved;
+}
+
+// policy: What the create detour found in tex_policy for this checksum
+tsf::RenderFix::tex_partition_t
+tsf::RenderFix::TextureManager::classifyTexture ( uint32_t                checksum,
+                                                  const tsf_tex_policy_s* policy )
+{
+  if (checksum == FONT_CRC32)
+    return PartitionFont;
+
+  return policy != nullptr ? policy->partition :
+                             PartitionWorld;
+}
+
+// Whether any partition has grown past its own maximum
+bool
+tsf::RenderFix::TextureManager::overQuota (void)
+{
+  for (int i = 0; i < PartitionCount; i++) {
+    const tex_partition_s& part = partitions [i];
+
+    if ( part.policy   != EvictNever &&
+         part.max_size >  0LL        &&
+         part.size     >  part.max_size )
+      return true;
   }
-  LeaveCriticalSection (&cs_cache);
 
-  updateOSD ();
+  return false;
 }
 
 void
@@ -2440,12 +7505,11 @@ tsf::RenderFix::TextureManager::removeTexture (ISKTextureD3D9* pTexD3D9)
   LeaveCriticalSection (&cs_cache);
 }
 
+// The caller has already added the reference (acquireTexture)
 void
 tsf::RenderFix::TextureManager::refTexture (tsf::RenderFix::Texture* pTex)
 {
-  pTex->d3d9_tex->AddRef ();
-  pTex->refs++;
-
+  InterlockedIncrement (&pTex->refs);
   InterlockedIncrement (&hits);
 
   if (config.textures.log) {
@@ -2454,7 +7518,7 @@ tsf::RenderFix::TextureManager::refTexture (tsf::RenderFix::Texture* pTex)
                        pTex->load_time );
   }
 
-  time_saved += pTex->load_time;
+  InterlockedAdd64 (&time_saved_us, (LONG64)(pTex->load_time * 1000.0f));
 
   updateOSD ();
 }
@@ -2481,6 +7545,37 @@ _endthreadex_Detour (
   return;
 }
 
+static void
+TSFix_InitPartition ( tsf::RenderFix::tex_partition_s& part,
+                      const char*                      name,
+                      const std::wstring&              spec )
+{
+  int     min_mib        = 0,
+          max_mib        = 0;
+  wchar_t wszPolicy [16] = { L'\0' };
+
+  swscanf (spec.c_str (), L"%d,%d,%15s", &min_mib, &max_mib, wszPolicy);
+
+  part.name     = name;
+  part.min_size = std::max (0, min_mib) * 1024LL * 1024LL;
+  part.max_size = std::max (0, max_mib) * 1024LL * 1024LL;
+
+  if      (! _wcsicmp (wszPolicy, L"Never"))
+    part.policy = tsf::RenderFix::EvictNever;
+  else if (! _wcsicmp (wszPolicy, L"Last"))
+    part.policy = tsf::RenderFix::EvictLast;
+  else
+    part.policy = tsf::RenderFix::EvictLRU;
+
+  tex_log->Log ( L"[ Tex. Mgr ] Partition %-14hs: Min=%4li MiB, Max=%4li MiB, Eviction=%s",
+                   name,
+                     std::max (0, min_mib),
+                       std::max (0, max_mib),
+                         part.policy == tsf::RenderFix::EvictNever ? L"Never" :
+                         part.policy == tsf::RenderFix::EvictLast  ? L"Last"  :
+                                                                     L"LRU" );
+}
+
 void
 tsf::RenderFix::TextureManager::Init (void)
 {
@@ -2509,7 +7604,12 @@ tsf::RenderFix::TextureManager::Init (void)
   inject_blacklist.insert (0x1e5c8a5e); // Criware Logo - "
   inject_blacklist.insert (0x5606ed7b); // Another Namco Logo
 
-  CrcGenerateTable ();
+  CrcGenerateTable   ();
+  Crc64GenerateTable ();
+
+  InitializeCriticalSectionAndSpinCount (&cs_shared, 1000UL);
+
+  load_pool.init ();
 
   CFileInStream arc_stream;
   CLookToRead   look_stream;
@@ -2560,6 +7660,8 @@ tsf::RenderFix::TextureManager::Init (void)
             rec.size    = (uint32_t)fsize.QuadPart;
             rec.archive = -1;
             rec.method  = Blocking;
+            rec.written = ((uint64_t)fd.ftLastWriteTime.dwHighDateTime << 32ULL) |
+                                     fd.ftLastWriteTime.dwLowDateTime;
 
             injectable_textures.insert (std::make_pair (checksum, rec));
           }
@@ -2596,6 +7698,8 @@ tsf::RenderFix::TextureManager::Init (void)
             rec.size    = (uint32_t)fsize.QuadPart;
             rec.archive = -1;
             rec.method  = Streaming;
+            rec.written = ((uint64_t)fd.ftLastWriteTime.dwHighDateTime << 32ULL) |
+                                     fd.ftLastWriteTime.dwLowDateTime;
 
             injectable_textures.insert (std::make_pair (checksum, rec));
           }
@@ -2632,6 +7736,8 @@ tsf::RenderFix::TextureManager::Init (void)
             rec.size    = (uint32_t)fsize.QuadPart;
             rec.archive = -1;
             rec.method  = DontCare;
+            rec.written = ((uint64_t)fd.ftLastWriteTime.dwHighDateTime << 32ULL) |
+                                     fd.ftLastWriteTime.dwLowDateTime;
 
             if (! injectable_textures.count (checksum))
               injectable_textures.insert (std::make_pair (checksum, rec));
@@ -2752,6 +7858,25 @@ tsf::RenderFix::TextureManager::Init (void)
               if (tex_count > 0) {
                 ++archive;
                 archives.push_back (wszQualifiedArchiveName);
+
+                // Parsed once, the load pipeline reads and decodes from it
+                archive_dbs.push_back (
+                  new SK_TextureArchive (wszQualifiedArchiveName, arc)
+                );
+
+                // Belongs to the archive now, SzArEx_Free below must not free it
+                SzArEx_Init (&arc);
+
+                // Changes whenever the archive is replaced or modified, so that
+                //   stale entries in the disk cache are never used.
+                uint32_t id =
+                  crc32 (0x00, wszArchiveNameLwr, wcslen (wszArchiveNameLwr) * sizeof (wchar_t));
+
+                id = crc32 (id, &fd.nFileSizeLow,    sizeof (fd.nFileSizeLow));
+                id = crc32 (id, &fd.nFileSizeHigh,   sizeof (fd.nFileSizeHigh));
+                id = crc32 (id, &fd.ftLastWriteTime, sizeof (fd.ftLastWriteTime));
+
+                archive_ids.push_back (id);
               }
             }
 
@@ -2822,6 +7947,45 @@ tsf::RenderFix::TextureManager::Init (void)
                        files, (double)liSize.QuadPart / (1024.0 * 1024.0) );
   }
 
+  const wchar_t* wszCRC32 =
+    config.textures.partitions.ui_crc32s.c_str ();
+
+  while (*wszCRC32 != L'\0') {
+    wchar_t* wszEnd   = nullptr;
+    uint32_t checksum = wcstoul (wszCRC32, &wszEnd, 16);
+
+    // Separator
+    if (wszEnd == wszCRC32) {
+      ++wszCRC32;
+      continue;
+    }
+
+    ui_textures.insert (checksum);
+    wszCRC32 = wszEnd;
+  }
+
+  if (! ui_textures.empty ())
+    tex_log->Log (L"[ Tex. Mgr ] %lu textures assigned to the UI partition", ui_textures.size ());
+
+  tex_policy.build ();
+
+  content_index.init ();
+
+  // Everything injectable, plus the custom font
+  in_flight.init (injectable_textures.size () + 1);
+
+  tex_log->Log ( L"[ Tex. Mgr ] Texture policy index: %lu slots for %lu injectable, "
+                 L"%lu dumped and %lu blacklisted",
+                   tex_policy.size (),
+                     injectable_textures.size (),
+                       dumped_textures.size (),
+                         inject_blacklist.size () );
+
+  // Everything has been copied into the index
+  std::unordered_map <uint32_t, tsf_tex_record_s> ().swap (injectable_textures);
+  std::set           <uint32_t>                   ().swap (dumped_textures);
+  std::set           <uint32_t>                   ().swap (ui_textures);
+
 
   TSFix_CreateDLLHook2 ( config.system.injector.c_str (),
                          "D3D9StretchRect_Override",
@@ -2902,20 +8066,52 @@ tsf::RenderFix::TextureManager::Init (void)
         GetProcAddress (hModD3D9, "D3D9CreateDepthStencilSurface_Override");
   }
 
-  time_saved = 0.0f;
+  time_saved_us = 0LL;
+  cache_budget  = config.textures.max_cache_in_mib;
+
+  EnterCriticalSection (&cs_cache);
+  {
+    if (tex_index == nullptr)
+      tex_index = new tsf_tex_index_s (4096);
+  }
+  LeaveCriticalSection (&cs_cache);
 
   InitializeCriticalSectionAndSpinCount (&cs_tex_inject,   100000UL);
   InitializeCriticalSectionAndSpinCount (&cs_tex_resample, 1000UL);
-  InitializeCriticalSectionAndSpinCount (&cs_tex_stream,   1000UL);
 
-  decomp_semaphore = 
-    CreateSemaphore ( nullptr,
-                        config.textures.max_decomp_jobs,
-                          config.textures.max_decomp_jobs,
-                            nullptr );
+  TSFix_InitPartition (partitions [PartitionUI],       "UI Textures",
+                         config.textures.partitions.ui);
+  TSFix_InitPartition (partitions [PartitionFont],     "Font",
+                         config.textures.partitions.font);
+  TSFix_InitPartition (partitions [PartitionBlocking], "Blocking Loads",
+                         config.textures.partitions.blocking);
+  TSFix_InitPartition (partitions [PartitionWorld],    "World",
+                         config.textures.partitions.world);
+
+  reset_shadows.init ();
+  ram_cache.init     ();
+  disk_cache.init    ();
+
+  streaming_memory::init ();
 
-  stream_pool.lrg_tex = new SK_TextureThreadPool ();
-  stream_pool.sm_tex  = new SK_TextureThreadPool ();
+  SYSTEM_INFO sysinfo;
+  GetSystemInfo (&sysinfo);
+
+  // Decoding is CPU bound, more decoders than CPUs left over after the
+  //   render thread only get in each other's way.
+  int cpus     = sysinfo.dwNumberOfProcessors > 4 ? sysinfo.dwNumberOfProcessors - 1 :
+                                                    sysinfo.dwNumberOfProcessors;
+  int decoders = std::max (1, std::min (config.textures.max_decomp_jobs, cpus));
+  int readers  = std::max (1, config.textures.io_threads);
+  int creators = 2;
+
+  stream_pool.init (readers, decoders, creators);
+
+  idle_prefetch.init   ();
+  scene_predictor.init ();
+
+  tex_log->Log ( L"[ Tex. Mgr ] Load pipeline: %li I/O, %li decode and %li create thread(s)",
+                   readers, decoders, creators );
 
   SK_GetCommandProcessor ()->AddVariable (
     "Textures.Remap",
@@ -2933,37 +8129,173 @@ tsf::RenderFix::TextureManager::Init (void)
     "Textures.ShowCache",
       TSF_CreateVar (SK_IVariable::Boolean, &__show_cache) );
 
-  TSFix_ApplyQueuedHooks ();
-}
+  SK_GetCommandProcessor ()->AddVariable (
+    "Textures.AdaptiveCache",
+      TSF_CreateVar (SK_IVariable::Boolean, &config.textures.adaptive_cache) );
+
+  SK_GetCommandProcessor ()->AddVariable (
+    "Textures.MinCacheSize",
+      TSF_CreateVar (SK_IVariable::Int, &config.textures.min_cache_in_mib) );
+
+  SK_GetCommandProcessor ()->AddVariable (
+    "Textures.CompletionBudget",
+      TSF_CreateVar (SK_IVariable::Int, &config.textures.completion_us) );
+
+  TSFix_ApplyQueuedHooks ();
+}
+
+// Skip the purge step on shutdown
+bool shutting_down = false;
+
+void
+tsf::RenderFix::TextureManager::Shutdown (void)
+{
+  while (! textures_to_resample.empty ())
+    textures_to_resample.pop ();
+
+  shutting_down = true;
+
+  tex_mgr.reset ();
+
+  DeleteCriticalSection (&cs_tex_resample);
+  DeleteCriticalSection (&cs_tex_inject);
+
+  // Before the prefetcher, nothing may be predicted once it is gone
+  scene_predictor.finish ();
+
+  reset_shadows.shutdown ();
+  idle_prefetch.shutdown ();
+  content_index.shutdown ();
+
+  if (scene_predictor.visits () > 0) {
+    tex_log->Log ( L"[Perf Stats] At shutdown: Scene predictions for %lu area visits were "
+                   L"%5.1f%% precise with %5.1f%% recall",
+                     scene_predictor.visits    (),
+                       scene_predictor.precision (),
+                         scene_predictor.recall    () );
+  }
+
+  if (idle_prefetch.prefetched () > 0) {
+    tex_log->Log ( L"[Perf Stats] At shutdown: %li textures (%7.2f MiB) were prefetched "
+                   L"while idle, %lu of them were used",
+                     idle_prefetch.prefetched (),
+                       (double)idle_prefetch.bytes () / 1024.0,
+                         ram_cache.prefetchHits () );
+  }
+
+  if (ram_cache.hits () + ram_cache.misses () > 0) {
+    tex_log->Log ( L"[Perf Stats] At shutdown: RAM cache served %lu of %lu"
+                   L" injected loads",
+                     ram_cache.hits (),
+                       ram_cache.hits () + ram_cache.misses () );
+  }
+
+  ram_cache.shutdown     ();
+
+  if (disk_cache.hits () + disk_cache.misses () > 0) {
+    tex_log->Log ( L"[Perf Stats] At shutdown: Disk cache served %lu of %lu"
+                   L" archived loads",
+                     disk_cache.hits (),
+                       disk_cache.hits () + disk_cache.misses () );
+  }
+
+  disk_cache.shutdown    ();
+  in_flight.shutdown     ();
+  load_pool.shutdown     ();
+
+  if (shared_loads > 0) {
+    tex_log->Log ( L"[Perf Stats] At shutdown: %lu overrides were shared instead of loaded again",
+                     shared_loads );
+  }
+
+  if (cancelled_loads > 0) {
+    tex_log->Log ( L"[Perf Stats] At shutdown: %lu loads were cancelled, their texture was "
+                   L"released first",
+                     cancelled_loads );
+  }
+
+  if (preview_loads > 0) {
+    tex_log->Log ( L"[Perf Stats] At shutdown: %lu overrides were shown at reduced "
+                   L"resolution until their full mip chain was ready",
+                     preview_loads );
+  }
+
+  if (staged_upload_count > 0) {
+    tex_log->Log ( L"[Perf Stats] At shutdown: %lu textures (%7.2f MiB) were uploaded "
+                   L"at the end of a frame",
+                     staged_upload_count,
+                       (double)staged_upload_bytes / (1024.0 * 1024.0) );
+  }
+
+  if (load_phase.screens () > 0) {
+    tex_log->Log ( L"[Perf Stats] At shutdown: %lu loading screens (%li PAC loads) "
+                   L"took %7.2f seconds",
+                     load_phase.screens (),
+                       load_phase.pacs (),
+                         load_phase.loadingSecs () );
+  }
+
+  // Stops waiting workers; archives stay open until the process is gone,
+  //   one could still be busy with a read.
+  stream_pool.shutdown ();
+
+  if (stream_pool.folderBatches () > 0) {
+    tex_log->Log ( L"[Perf Stats] At shutdown: %li solid folders were decoded once for "
+                   L"%li more textures",
+                     stream_pool.folderBatches (),
+                       stream_pool.folderMates () );
+  }
+
+  for (auto it : archive_dbs) {
+    if (it->requests () == 0)
+      continue;
 
-// Skip the purge step on shutdown
-bool shutting_down = false;
+    tex_log->Log ( L"[Perf Stats] At shutdown: %s: %lu reads for %lu requests, seeked "
+                   L"%7.2f MiB (%7.2f MiB in request order)",
+                     it->name     (),
+                       it->reads    (),
+                         it->requests (),
+                           (double)it->seekBytes     () / (1024.0 * 1024.0),
+                           (double)it->seekBytesFIFO () / (1024.0 * 1024.0) );
+  }
 
-void
-tsf::RenderFix::TextureManager::Shutdown (void)
-{
-  while (! textures_to_resample.empty ())
-    textures_to_resample.pop ();
+  static const wchar_t* wszStages [SK_TextureScheduler::StageCount] =
+    { L"I/O", L"Decode", L"Create" };
 
-  shutting_down = true;
+  for (int i = 0; i < SK_TextureScheduler::StageCount; i++) {
+    SK_TextureStageStats& stats = stream_pool.stageStats (i);
 
-  tex_mgr.reset ();
+    stats.sample (stream_pool.stageThreads (i));
 
-  DeleteCriticalSection (&cs_tex_stream);
-  DeleteCriticalSection (&cs_tex_resample);
-  DeleteCriticalSection (&cs_tex_inject);
+    if (stats.totalItems () == 0)
+      continue;
 
-  DeleteCriticalSection (&cs_cache);
+    tex_log->Log ( L"[Perf Stats] At shutdown: %-6s stage handled %lli loads (%7.2f MiB), "
+                   L"busy %5.1f%% of the time",
+                     wszStages [i],
+                       stats.totalItems (),
+                         stats.totalMiB   (),
+                           stats.totalBusyPct (stream_pool.stageThreads (i)) );
+  }
 
-  CloseHandle (decomp_semaphore);
+  DeleteCriticalSection (&cs_cache);
 
   // 33.3 ms per-frame (30 FPS)
   const float frame_time = 33.3f;
 
+  const float time_saved = (float)time_saved_us / 1000.0f;
+
   tex_log->Log ( L"[Perf Stats] At shutdown: %7.2f seconds (%7.2f frames)"
                  L" saved by cache",
                    time_saved / 1000.0f,
                      time_saved / frame_time );
+  tex_log->Log ( L"[Perf Stats] At shutdown: %lu cache hits, %7.1f ns average"
+                 L" hit latency",
+                   hits,
+                     hits > 0 ? (double)hit_ns / (double)hits : 0.0 );
+  tex_log->Log ( L"[Perf Stats] At shutdown: %lu frames exceeded the texture"
+                 L" completion budget",
+                   completion_overruns );
   tex_log->close ();
 }
 
@@ -2973,113 +8305,276 @@ tsf::RenderFix::TextureManager::purge (void)
   if (shutting_down)
     return;
 
-  int      released           = 0;
-  int      released_injected  = 0;
-  uint64_t reclaimed          = 0;
-  uint64_t reclaimed_injected = 0;
+  beginPurge ();
+  purgeSlice (0);
+}
+
+//
+// Picks the eviction candidates (least recently used first) and the target
+//   size; the actual releasing is done by purgeSlice (...), possibly spread
+//     across several frames.
+//
+void
+tsf::RenderFix::TextureManager::beginPurge (void)
+{
+  if (shutting_down)
+    return;
 
   tex_log->Log (L"[ Tex. Mgr ] -- TextureManager::purge (...) -- ");
 
   tex_log->Log ( L"[ Tex. Mgr ]  ***  Current Cache Size: %6.2f MiB "
-                                          L"(User Limit: %6.2f MiB)",
+                                          L"(User Limit: %6.2f MiB, Budget: %6.2f MiB)",
                    (double)cacheSizeTotal () / (1024.0 * 1024.0),
-                     (double)config.textures.max_cache_in_mib );
+                     (double)config.textures.max_cache_in_mib,
+                       (double)cache_budget );
 
   // Purge any pending removes
-  getTexture (0);
+  flushRemoves ();
 
-  tex_log->Log (L"[ Tex. Mgr ]   Releasing textures...");
+  // Everything the sort and the candidate passes look at, packed together
+  //   so that they do not chase two pointers per texture for every compare.
+  struct candidate_s {
+    LONGLONG        last_used;
+    uint32_t        crc32;
+    tex_partition_t partition;
+  };
 
-  std::unordered_map <uint32_t, tsf::RenderFix::Texture *>::iterator it =
-    textures.begin ();
+  std::vector <candidate_s> unreferenced_textures;
+
+  EnterCriticalSection (&cs_cache);
+  {
+    unreferenced_textures.reserve (textures.size ());
 
-  std::vector <tsf::RenderFix::Texture *> unreferenced_textures;
+    std::unordered_map <uint32_t, tsf::RenderFix::Texture *>::iterator it =
+      textures.begin ();
 
-  while (it != textures.end ()) {
-    if ((*it).second->d3d9_tex->can_free)
-      unreferenced_textures.push_back ((*it).second);
+    while (it != textures.end ()) {
+      ISKTextureD3D9* pSKTex = (*it).second->d3d9_tex;
 
-    ++it;
+      if (pSKTex->can_free) {
+        unreferenced_textures.push_back ( { pSKTex->last_used.QuadPart,
+                                              (*it).first,
+                                                pSKTex->partition } );
+      }
+
+      ++it;
+    }
   }
+  LeaveCriticalSection (&cs_cache);
 
   std::sort ( unreferenced_textures.begin (),
                 unreferenced_textures.end (),
-      []( tsf::RenderFix::Texture *a,
-          tsf::RenderFix::Texture *b )
+      []( const candidate_s& a,
+          const candidate_s& b )
     {
-      return a->d3d9_tex->last_used.QuadPart <
-             b->d3d9_tex->last_used.QuadPart;
+      return a.last_used < b.last_used;
     }
   );
 
-  std::vector <tsf::RenderFix::Texture *>::iterator free_it =
-    unreferenced_textures.begin ();
+  purge_job.candidates.clear ();
+  purge_job.candidates.reserve (unreferenced_textures.size ());
+
+  // Partitions above their own maximum go first, regardless of the budget
+  for (const auto& it : unreferenced_textures) {
+    const tex_partition_s& part =
+      partitions [it.partition];
+
+    if ( part.policy   != EvictNever &&
+         part.max_size >  0LL        &&
+         part.size     >  part.max_size )
+      purge_job.candidates.push_back (it.crc32);
+  }
+
+  purge_job.over_quota = purge_job.candidates.size ();
+
+  for (const auto& it : unreferenced_textures) {
+    if (partitions [it.partition].policy == EvictLRU)
+      purge_job.candidates.push_back (it.crc32);
+  }
+
+  for (const auto& it : unreferenced_textures) {
+    if (partitions [it.partition].policy == EvictLast)
+      purge_job.candidates.push_back (it.crc32);
+  }
+
+  for (int i = 0; i < PartitionCount; i++)
+    purge_job.part_reclaimed [i] = 0LL;
+
+  purge_job.next               = 0;
+  purge_job.slices             = 0;
+  purge_job.released           = 0;
+  purge_job.released_injected  = 0;
+  purge_job.downgraded         = 0;
+  purge_job.reclaimed          = 0ULL;
+  purge_job.reclaimed_injected = 0ULL;
+  purge_job.release_only       = memory_low;
 
   // We need to over-free, or we will likely be purging every other texture load
-  int64_t target_size =
-    std::max (128, config.textures.max_cache_in_mib - 64) * 1024LL * 1024LL;
-  int64_t start_size =
+  purge_job.target_size =
+    std::max (128, cache_budget - 64) * 1024LL * 1024LL;
+  purge_job.start_size  =
     cacheSizeTotal ();
 
-  while ( start_size - reclaimed > target_size &&
-            free_it != unreferenced_textures.end () ) {
-    int             tex_refs = -1;
-    ISKTextureD3D9* pSKTex   = (*free_it)->d3d9_tex;
+  purge_job.active = true;
+
+  tex_log->Log (L"[ Tex. Mgr ]   Releasing textures...");
+}
+
+//
+// Releases candidates until the target is reached or budget_us elapses
+//   (0 = no limit). Returns true once the purge is complete.
+//
+bool
+tsf::RenderFix::TextureManager::purgeSlice (int budget_us)
+{
+  if (shutting_down || (! purge_job.active))
+    return true;
+
+  LARGE_INTEGER freq, start, now;
+  QueryPerformanceFrequency        (&freq);
+  QueryPerformanceCounter_Original (&start);
+
+  const LONGLONG budget =
+    budget_us > 0 ? (LONGLONG)budget_us * freq.QuadPart / 1000000LL :
+                    std::numeric_limits <LONGLONG>::max ();
+
+  ++purge_job.slices;
+
+  now = start;
+
+  while ( purge_job.next < purge_job.candidates.size () &&
+            now.QuadPart - start.QuadPart < budget ) {
+    bool quota_pass =
+      purge_job.next < purge_job.over_quota;
+
+    if ( (! quota_pass) &&
+           purge_job.start_size - (int64_t)purge_job.reclaimed <= purge_job.target_size )
+      break;
+
+    uint32_t checksum =
+      purge_job.candidates [purge_job.next++];
+
+    ISKTextureD3D9* pSKTex = nullptr;
+
+    // The record may have been referenced again, or removed altogether,
+    //   since the candidates were picked...
+    EnterCriticalSection (&cs_cache);
+    {
+      auto tex = textures.find (checksum);
+
+      if ( tex != textures.end ()          &&
+           tex->second->d3d9_tex->can_free &&
+           tex->second->d3d9_tex->refs > 0 )
+        pSKTex = tex->second->d3d9_tex;
+    }
+    LeaveCriticalSection (&cs_cache);
+
+    if (pSKTex == nullptr)
+      continue;
+
+    int tex_refs = -1;
 
     //
     // Skip loads that are in-flight so that we do not hitch
     //
-    if (is_streaming ((*free_it)->crc32)) {
-      ++free_it;
+    if (is_streaming (checksum))
+      continue;
+
+    //
+    // Blocking loads are in a partition that is never evicted by default,
+    //   they are generally small and will cause performance problems if we
+    //     have to reload them again later.
+    //
+    tex_partition_t        partition = pSKTex->partition;
+    const tex_partition_s& part      = partitions [partition];
+
+    int64_t part_size =
+      part.size - purge_job.part_reclaimed [partition];
+
+    if (part_size - (pSKTex->tex_size + pSKTex->override_size) < part.min_size)
+      continue;
+
+    if (quota_pass && part_size <= part.max_size)
       continue;
-    }
 
     //
-    // Do not evict blocking loads, they are generally small and
-    //   will cause performance problems if we have to reload them
-    //     again later.
+    // Large overrides lose their top mip levels before being evicted, they
+    //   stay resident and get full resolution back once used again.
+    //
+    //   Nothing is freed until the reduced copy replaces the full chain
+    //     (noteDowngrade), both are resident until then. So it is not done
+    //       when memory is already low, that would only raise the peak.
     //
-    if (pSKTex->must_block) {
-      ++free_it;
+    UINT skip =
+      purge_job.release_only ? 0 : TSFix_MipsToDrop (pSKTex);
+
+    if (skip > 0 && TSFix_ReloadOverride (pSKTex, skip, PriorityPrefetch)) {
+      ++purge_job.downgraded;
+
+      QueryPerformanceCounter_Original (&now);
       continue;
     }
 
     int64_t ovr_size  = 0;
     int64_t base_size = 0;
 
-    ++free_it;
-
     base_size = pSKTex->tex_size;
     ovr_size  = pSKTex->override_size;
     tex_refs  = pSKTex->Release ();
 
+    purge_job.part_reclaimed [partition] += base_size + ovr_size;
+
     if (tex_refs == 0) {
       if (ovr_size != 0) {
-        reclaimed += ovr_size;
+        purge_job.reclaimed += ovr_size;
 
-        released_injected++;
-        reclaimed_injected += ovr_size;
+        purge_job.released_injected++;
+        purge_job.reclaimed_injected += ovr_size;
       }
     } else {
       tex_log->Log (L"[ Tex. Mgr ] Invalid reference count (%lu)!", tex_refs);
     }
 
-    ++released;
-    reclaimed  += base_size;
+    ++purge_job.released;
+    purge_job.reclaimed  += base_size;
+
+    QueryPerformanceCounter_Original (&now);
   }
 
+  bool done =
+    purge_job.next >= purge_job.candidates.size () ||
+    ( purge_job.next >= purge_job.over_quota &&
+      purge_job.start_size - (int64_t)purge_job.reclaimed <= purge_job.target_size );
+
+  if (! done)
+    return false;
+
+  purge_job.active = false;
+
   tex_log->Log ( L"[ Tex. Mgr ]   %4d textures (%4d remain)",
-                   released,
+                   purge_job.released,
                      textures.size () );
 
   tex_log->Log ( L"[ Tex. Mgr ]   >> Reclaimed %6.2f MiB of memory (%6.2f MiB from %lu inject)",
-                   (double)reclaimed        / (1024.0 * 1024.0),
-                   (double)reclaimed_injected / (1024.0 * 1024.0),
-                           released_injected );
+                   (double)purge_job.reclaimed          / (1024.0 * 1024.0),
+                   (double)purge_job.reclaimed_injected / (1024.0 * 1024.0),
+                           purge_job.released_injected );
+
+  if (purge_job.downgraded > 0) {
+    tex_log->Log ( L"[ Tex. Mgr ]   >> %lu overrides queued for lower mip levels",
+                     purge_job.downgraded );
+  }
+
+  if (purge_job.slices > 1) {
+    tex_log->Log ( L"[ Tex. Mgr ]   >> Spread across %lu frames",
+                     purge_job.slices );
+  }
 
   updateOSD ();
 
   tex_log->Log (L"[ Tex. Mgr ] ----------- Finished ------------ ");
+
+  return true;
 }
 
 void
@@ -3100,8 +8595,11 @@ tsf::RenderFix::TextureManager::reset (void)
 
   tex_log->Log (L"[ Tex. Mgr ] -- TextureManager::reset (...) -- ");
 
+  // Anything a sliced purge still has queued is about to be released anyway
+  purge_job.active = false;
+
   // Purge any pending removes
-  getTexture (0);
+  flushRemoves ();
 
   tex_log->Log (L"[ Tex. Mgr ]   Releasing textures...");
 
@@ -3118,6 +8616,10 @@ tsf::RenderFix::TextureManager::reset (void)
     int64_t base_size = 0;
     int64_t ovr_size  = 0;
 
+    // Restores after the Reset are ordered by this
+    if (pSKTex->pTexOverride != nullptr)
+      reset_shadows.touch (pSKTex->tex_crc32, pSKTex->last_used.QuadPart);
+
     if (pSKTex->can_free) {
       can_free = true;
       base_size = pSKTex->tex_size;
@@ -3214,14 +8716,30 @@ tsf::RenderFix::TextureManager::reset (void)
 
   // Commit this immediately, such that D3D9 Reset will not fail in
   //   fullscreen mode...
-  TSFix_LoadQueuedTextures ();
-  purge                    ();
+  TSFix_CompleteQueuedTextures (0);
+  purge                        ();
 
   tex_log->Log (L"[ Tex. Mgr ] ----------- Finished ------------ ");
 }
 
 void
 tsf::RenderFix::TextureManager::updateOSD (void)
+{
+  InterlockedExchange (&osd_dirty, 1);
+}
+
+// Rebuilt at most once per-frame, and only while the OSD is visible
+std::string
+tsf::RenderFix::TextureManager::osdStats (void)
+{
+  if (InterlockedExchange (&osd_dirty, 0))
+    rebuildOSD ();
+
+  return osd_stats;
+}
+
+void
+tsf::RenderFix::TextureManager::rebuildOSD (void)
 {
   double cache_basic    = (double)cacheSizeBasic    () / (1024.0f * 1024.0f);
   double cache_injected = (double)cacheSizeInjected () / (1024.0f * 1024.0f);
@@ -3259,19 +8777,332 @@ tsf::RenderFix::TextureManager::updateOSD (void)
 
   osd_stats += szFormatted;
 
-  sprintf ( szFormatted, "%6lu Cache Hits     : %8.2f Seconds Saved",
-              hits,
-                time_saved / 1000.0f );
+  sprintf ( szFormatted, "%6lu Cache Hits     : %8.2f Seconds Saved",
+              hits,
+                (double)time_saved_us / 1000000.0 );
+
+  osd_stats += szFormatted;
+
+  if (hits > 0) {
+    sprintf ( szFormatted, "  (%5.0f ns/hit)",
+                (double)hit_ns / (double)hits );
+
+    osd_stats += szFormatted;
+  }
+
+  osd_stats += "\n";
+
+  sprintf ( szFormatted, "       Cache Budget   : %5li MiB    %s",
+              cache_budget,
+                config.textures.adaptive_cache ? "(Adaptive)" : "(Fixed)" );
+
+  osd_stats += szFormatted;
+
+  if (config.textures.adaptive_cache) {
+    sprintf ( szFormatted, "  [VA: %4lu MiB Free, %4lu MiB Contiguous]",
+                free_va,
+                  largest_va );
+
+    osd_stats += szFormatted;
+  }
+
+  ULONG  shared_count = 0UL;
+  double shared_mib   = 0.0;
+
+  EnterCriticalSection (&cs_shared);
+  {
+    for (auto it : shared_overrides) {
+      if (it.second.users.size () > 1) {
+        shared_count += (ULONG)it.second.users.size () - 1;
+        shared_mib   += (double)(it.second.users.size () - 1) *
+                        (double)it.second.users.front ()->override_size / (1024.0 * 1024.0);
+      }
+    }
+  }
+  LeaveCriticalSection (&cs_shared);
+
+  if (shared_count > 0) {
+    sprintf ( szFormatted, "\n%6lu Shared         : %8.2f MiB    (Not Loaded Again)",
+                shared_count,
+                  shared_mib );
+
+    osd_stats += szFormatted;
+  }
+
+  for (int i = 0; i < PartitionCount; i++) {
+    const tex_partition_s& part = partitions [i];
+
+    const char* szPolicy =
+      part.policy == EvictNever ? "Never" :
+      part.policy == EvictLast  ? "Last"  :
+                                  "LRU";
+
+    char szQuota [24];
+
+    if (part.policy != EvictNever && part.max_size > 0LL)
+      sprintf (szQuota, "%s, <= %lli MiB", szPolicy, part.max_size / (1024LL * 1024LL));
+    else
+      sprintf (szQuota, "%s", szPolicy);
+
+    sprintf ( szFormatted, "\n%6li %-15s: %8.2f MiB    (%s)",
+                part.count,
+                  part.name,
+                    (double)part.size / (1024.0 * 1024.0),
+                      szQuota );
+
+    osd_stats += szFormatted;
+  }
+
+  static const char* szPriorities [PriorityCount] =
+    { "Blocking", "Visible", "Streaming", "Prefetch" };
+
+  for (int i = 0; i < PriorityCount; i++) {
+    if (! stream_pool.used (i))
+      continue;
+
+    sprintf ( szFormatted, "\n%6li Queue %-9s: %8.2f ms     (Avg. Wait)",
+                stream_pool.depth  (i),
+                  szPriorities [i],
+                    stream_pool.waitMs (i) );
+
+    osd_stats += szFormatted;
+  }
+
+  ULONG  arc_reads = 0UL, arc_merged = 0UL;
+  UInt64 arc_seek  = 0ULL;
+
+  for (auto it : archive_dbs) {
+    arc_reads  += it->reads     ();
+    arc_merged += it->merged    ();
+    arc_seek   += it->seekBytes ();
+  }
+
+  if (arc_reads > 0) {
+    sprintf ( szFormatted, "\n%6lu Archive Reads  : %8.2f MiB    (Seek Dist., %lu Merged)",
+                arc_reads,
+                  (double)arc_seek / (1024.0 * 1024.0),
+                    arc_merged );
+
+    osd_stats += szFormatted;
+  }
+
+  if (stream_pool.folderBatches () > 0) {
+    sprintf ( szFormatted, "\n%6li Folder Batches : %8li Loads  (Decoded Along)",
+                stream_pool.folderBatches (),
+                  stream_pool.folderMates () );
+
+    osd_stats += szFormatted;
+  }
+
+  if (idle_prefetch.prefetched () > 0) {
+    sprintf ( szFormatted, "\n%6li Idle Prefetch  : %8.2f MiB    (%lu Used)",
+                idle_prefetch.prefetched (),
+                  (double)idle_prefetch.bytes () / 1024.0,
+                    ram_cache.prefetchHits () );
+
+    osd_stats += szFormatted;
+  }
+
+  if (scene_predictor.visits () > 0) {
+    sprintf ( szFormatted, "\n%6lu Scene Predict. : %7.1f%% Prec.  (%.1f%% Recall)",
+                scene_predictor.visits    (),
+                  scene_predictor.precision (),
+                    scene_predictor.recall    () );
+
+    osd_stats += szFormatted;
+  }
+
+  if (load_phase.screens () > 0) {
+    sprintf ( szFormatted, "\n%6lu Load Screens   : %8.2f s      (%s)",
+                load_phase.screens (),
+                  load_phase.loadingSecs (),
+                    load_phase.loading () ? "Loading" : "Gameplay" );
+
+    osd_stats += szFormatted;
+  }
+
+  if (staged_upload_count > 0) {
+    sprintf ( szFormatted, "\n%6lu Staged Uploads : %8.2f MiB    (Last Frame)",
+                staged_uploads.size (),
+                  (double)staged_upload_last / (1024.0 * 1024.0) );
+
+    osd_stats += szFormatted;
+  }
+
+  if (preview_loads > 0) {
+    sprintf ( szFormatted, "\n%6li Mip Previews   : %8.2f MiB    (Shown First)",
+                preview_loads,
+                  (double)preview_bytes / 1024.0 );
+
+    osd_stats += szFormatted;
+  }
+
+  static const char* szStages [SK_TextureScheduler::StageCount] =
+    { "I/O", "Decode", "Create" };
+
+  for (int i = 0; i < SK_TextureScheduler::StageCount; i++) {
+    SK_TextureStageStats& stats = stream_pool.stageStats (i);
+
+    if (! stats.used ())
+      continue;
+
+    stats.sample (stream_pool.stageThreads (i));
+
+    sprintf ( szFormatted, "\n%6li Stage %-9s: %8.2f MiB/s  (%5.1f/s, %3.0f%% Busy)",
+                stream_pool.stageDepth (i),
+                  szStages [i],
+                    stats.mibSec  (),
+                      stats.perSec  (),
+                        stats.busyPct () );
+
+    osd_stats += szFormatted;
+  }
+
+  if (reset_shadows.enabled ()) {
+    sprintf ( szFormatted, "\n%6lu Reset Shadows  : %8.2f MiB    (%lu Restored)",
+                reset_shadows.count (),
+                  (double)reset_shadows.bytes () / (1024.0 * 1024.0),
+                    reset_shadows.restored () );
+
+    osd_stats += szFormatted;
+  }
+
+  if (ram_cache.enabled ()) {
+    ULONG lookups = ram_cache.hits () + ram_cache.misses ();
+
+    sprintf ( szFormatted, "\n%6lu RAM Cache      : %8.2f MiB    (%5.1f%% Hit Rate)",
+                ram_cache.count (),
+                  (double)ram_cache.bytes () / (1024.0 * 1024.0),
+                    lookups > 0 ? 100.0 * (double)ram_cache.hits () / (double)lookups :
+                                  0.0 );
+
+    osd_stats += szFormatted;
+  }
+
+  if (disk_cache.enabled ()) {
+    ULONG lookups = disk_cache.hits () + disk_cache.misses ();
+
+    sprintf ( szFormatted, "\n%6lu Disk Cache     : %8.2f MiB    (%5.1f%% Hit Rate)",
+                disk_cache.count (),
+                  (double)disk_cache.bytes () / (1024.0 * 1024.0),
+                    lookups > 0 ? 100.0 * (double)disk_cache.hits () / (double)lookups :
+                                  0.0 );
+
+    osd_stats += szFormatted;
+  }
+
+  if (debug_tex_id != 0x00) {
+    osd_stats += "\n\n";
+
+    sprintf ( szFormatted, " Debug Texture : %08x",
+                debug_tex_id );
+
+    osd_stats += szFormatted;
+  }
+}
+
+//
+// The game is a 32-bit process, and its address space fragments long before
+//   the GPU actually runs out of memory. The largest free block is therefore
+//     what predicts whether the next D3DX allocation will fail, so both it and
+//       available texture memory are tracked against a low watermark.
+//
+//  * Below either watermark  -> shrink the budget one step and purge
+//  * Above 2x both of them   -> grow the budget one step back toward the limit
+//  * Anywhere in between     -> hold (hysteresis, so we do not oscillate)
+//
+void
+tsf::RenderFix::TextureManager::updateBudget (void)
+{
+  const DWORD sample_interval = 500UL; // ms
+  const int   budget_step     = 64;    // MiB
+
+  static DWORD dwLastSample = 0UL;
+
+  int upper = config.textures.max_cache_in_mib;
+  int lower = std::min (config.textures.min_cache_in_mib, upper);
+
+  if (! config.textures.adaptive_cache) {
+    cache_budget = upper;
+    return;
+  }
+
+  DWORD dwNow = timeGetTime ();
+
+  if (dwNow - dwLastSample < sample_interval)
+    return;
+
+  dwLastSample = dwNow;
+
+  SYSTEM_INFO sysinfo;
+  GetSystemInfo (&sysinfo);
+
+  uint64_t total_free   = 0ULL;
+  uint64_t largest_free = 0ULL;
+
+  MEMORY_BASIC_INFORMATION mem_info;
+
+  uint8_t* addr = (uint8_t *)sysinfo.lpMinimumApplicationAddress;
+
+  while ( addr < (uint8_t *)sysinfo.lpMaximumApplicationAddress &&
+          VirtualQuery (addr, &mem_info, sizeof mem_info) ) {
+    if (mem_info.RegionSize == 0)
+      break;
+
+    if (mem_info.State == MEM_FREE) {
+      total_free   += mem_info.RegionSize;
+      largest_free  = std::max (largest_free, (uint64_t)mem_info.RegionSize);
+    }
+
+    addr = (uint8_t *)mem_info.BaseAddress + mem_info.RegionSize;
+  }
+
+  free_va    = (ULONG)(total_free   / 1048576ULL);
+  largest_va = (ULONG)(largest_free / 1048576ULL);
+
+  // D3D9 saturates this at 4095 MiB, in which case it tells us nothing
+  bool vram_known = false;
+
+  if (tsf::RenderFix::pDevice != nullptr) {
+    free_vram  = tsf::RenderFix::pDevice->GetAvailableTextureMem () / 1048576UL;
+    vram_known = (free_vram != 4095);
+  }
+
+  const ULONG low_va   = (ULONG)std::max (0, config.textures.min_free_va);
+  const ULONG low_vram = (ULONG)std::max (0, config.textures.min_free_vram);
+
+  bool under_low  =     largest_va < low_va ||
+                    (vram_known && free_vram < low_vram);
+  bool above_high =     largest_va >= 2 * low_va &&
+                    ((! vram_known) || free_vram >= 2 * low_vram);
+
+  memory_low = under_low;
+
+  int cache_mib  = (int)(cacheSizeTotal () / (1024LL * 1024LL));
+  int new_budget = std::max (lower, std::min (upper, cache_budget));
+
+  // Step down from whichever is smaller, otherwise a budget far above the
+  //   current cache size would take several samples to have any effect.
+  if (under_low)
+    new_budget = std::max (lower, std::min (new_budget, cache_mib) - budget_step);
+  else if (above_high)
+    new_budget = std::min (upper, new_budget + budget_step);
 
-  osd_stats += szFormatted;
+  if (new_budget != cache_budget) {
+    tex_log->Log ( L"[ Mem. Mgr ] Cache budget %s to %4li MiB "
+                   L"(VRAM: %4lu MiB, VA: %4lu MiB Free / %4lu MiB Contiguous)",
+                     new_budget < cache_budget ? L"reduced" : L"raised",
+                       new_budget,
+                         vram_known ? free_vram : 0UL,
+                           free_va,
+                             largest_va );
 
-  if (debug_tex_id != 0x00) {
-    osd_stats += "\n\n";
+    if (new_budget < cache_budget && cache_mib > new_budget)
+      __need_purge = true;
 
-    sprintf ( szFormatted, " Debug Texture : %08x",
-                debug_tex_id );
+    cache_budget = new_budget;
 
-    osd_stats += szFormatted;
+    updateOSD ();
   }
 }
 
@@ -3314,7 +9145,7 @@ TSFix_LogUsedTextures (void)
                        (double)pSKTex->override_size / 
                              (1024.0 * 1024.0) : 0.0,
 
-                           tsf::RenderFix::tex_mgr.getTexture (*it)->load_time,
+                           tex_record->load_time,
                              *it );
       }
     }
@@ -3324,36 +9155,341 @@ TSFix_LogUsedTextures (void)
     __log_used = false;
   }
 
+  scene_predictor.noteBound (textures_used);
+
   textures_used.clear ();
 }
 
 
-CRITICAL_SECTION        SK_TextureWorkerThread::cs_worker_init;
-ULONG                   SK_TextureWorkerThread::num_threads_init = 0UL;
+void
+SK_TextureScheduler::beginJob (tsf_tex_load_s* job)
+{
+  job->size = job->SrcDataSize;
 
-unsigned int
-__stdcall
-SK_TextureWorkerThread::ThreadProc (LPVOID user)
+  InterlockedIncrement   (&streaming);
+  InterlockedExchangeAdd (&streaming_bytes, job->size);
+
+  QueryPerformanceFrequency        (&job->freq);
+  QueryPerformanceCounter_Original (&job->start);
+}
+
+void
+SK_TextureScheduler::advance (tsf_tex_load_s* job, HRESULT hr, SK_TexturePipelineStage* next)
 {
-  EnterCriticalSection (&cs_worker_init);
-  {
-    DWORD dwThreadId = GetCurrentThreadId ();
+  if (SUCCEEDED (hr) && next != nullptr) {
+    if (next->post (job))
+      return;
+
+    // Shutting down
+    hr = E_ABORT;
+  }
+
+  finishJob (job, hr);
+}
+
+void
+SK_TextureScheduler::finishJob (tsf_tex_load_s* job, HRESULT hr)
+{
+  // Waiting for this one to decode their folder, which is not going to happen
+  while (job->folder_next != nullptr) {
+    tsf_tex_load_s* mate = job->folder_next;
+    job->folder_next     = mate->folder_next;
+
+    mate->folder_next = nullptr;
+
+    finishJob (mate, FAILED (hr) ? hr : E_ABORT);
+  }
+
+  QueryPerformanceCounter_Original (&job->end);
+
+  streaming_memory::release (job->buffer);
+
+  job->buffer   = nullptr;
+  job->pSrcData = nullptr;
+
+  InterlockedExchangeSubtract (&streaming_bytes, job->size);
+  InterlockedDecrement        (&streaming);
+
+  // Failures are completed too, anything waiting on them has to know
+  if (FAILED (hr) && job->pSrc != nullptr) {
+    job->pSrc->Release ();
+    job->pSrc = nullptr;
+  }
+
+  job->stage = tsf_tex_load_s::Finished;
+
+  // The job belongs to the render thread once posted, but whoever waits
+  //   on this event owns it and does not close it before it is signaled.
+  HANDLE hDone =
+    InterlockedExchangePointer (&job->done, INVALID_HANDLE_VALUE);
+
+  postFinished (job);
+
+  // INVALID_HANDLE_VALUE: A preview signaled it already
+  if (hDone != nullptr && hDone != INVALID_HANDLE_VALUE)
+    SetEvent (hDone);
+}
+
+void
+SK_TextureScheduler::postPreview (tsf_tex_load_s* job, tsf_tex_load_s* preview)
+{
+  postFinished (preview);
+
+  // Something to draw is all a blocked bind needs, the rest can follow
+  HANDLE hDone =
+    InterlockedExchangePointer (&job->done, INVALID_HANDLE_VALUE);
+
+  if (hDone != nullptr && hDone != INVALID_HANDLE_VALUE)
+    SetEvent (hDone);
+}
+
+void
+SK_TextureScheduler::runJob (tsf_tex_load_s* job)
+{
+  beginJob (job);
+
+  start_load ();
+
+  HRESULT hr =
+    TSFix_LoadCancelled (job) ? E_ABORT :
+                                InjectTexture (job);
+
+  end_load ();
+
+  finishJob (job, hr);
+}
+
+void
+SK_TextureScheduler::readArchived (SK_TextureArchive* pArc)
+{
+  std::vector <SK_TextureArchive::read_s> batch;
+
+  UInt64 offset = 0ULL;
+  size_t len    = 0;
+
+  while (pArc->nextRead (batch, &offset, &len)) {
+    LARGE_INTEGER start, end;
+    QueryPerformanceCounter_Original (&start);
+
+    // One read for the whole batch; a job that is alone keeps the buffer
+    void* data =
+      streaming_memory::alloc (len);
+
+    bool read =
+      data != nullptr && pArc->read (offset, data, len);
+
+    QueryPerformanceCounter_Original (&end);
+
+    io_stats_.record (end.QuadPart - start.QuadPart, len, (LONG)batch.size ());
+
+    // Requests for the same folder read the same range; the first one that
+    //   is still wanted decodes it for all of them.
+    for (size_t first = 0; first < batch.size (); ) {
+      size_t last = first + 1;
+
+      while (last < batch.size () && batch [last].start == batch [first].start)
+        ++last;
+
+      // In the order they are stored in the folder
+      std::sort ( batch.begin () + first, batch.begin () + last,
+                    [pArc] ( const SK_TextureArchive::read_s& a,
+                             const SK_TextureArchive::read_s& b ) {
+                      return pArc->fileOffset (a.load->record->fileno) <
+                             pArc->fileOffset (b.load->record->fileno);
+                    } );
+
+      const size_t job_len = (size_t)(batch [first].end - batch [first].start);
+
+      tsf_tex_load_s* lead  = nullptr;
+      tsf_tex_load_s* tail  = nullptr;
+      LONG            mates = 0L;
+
+      for (size_t i = first; i < last; i++) {
+        tsf_tex_load_s* job = batch [i].load;
+
+        // Died while its read was queued
+        if (TSFix_LoadCancelled (job)) {
+          advance (job, E_ABORT, &decode_);
+          continue;
+        }
+
+        if (lead == nullptr) {
+          lead = tail = job;
+          continue;
+        }
+
+        tail->folder_next = job;
+        tail              = job;
+
+        ++mates;
+      }
+
+      if (lead != nullptr) {
+        HRESULT hr = read ? S_OK : E_FAIL;
+
+        // The whole read was for this folder
+        if (read && last - first == batch.size ()) {
+          lead->buffer = data;
+          data         = nullptr;
+        }
+
+        else if (read) {
+          lead->buffer = streaming_memory::alloc (job_len);
+
+          if (lead->buffer != nullptr)
+            memcpy (lead->buffer, (uint8_t *)data + (batch [first].start - offset), job_len);
+          else
+            hr = E_OUTOFMEMORY;
+        }
+
+        lead->pSrcData    = lead->buffer;
+        lead->SrcDataSize = (UINT)job_len;
+
+        if (! read) {
+          tex_log->Log ( L"[Inject Tex]  ** Cannot read %08x from archive file: %s",
+                           lead->checksum,
+                             pArc->name () );
+        }
+
+        if (mates > 0) {
+          InterlockedIncrement   (&folder_batches_);
+          InterlockedExchangeAdd (&folder_mates_, mates);
+        }
+
+        advance (lead, hr, &decode_);
+      }
+
+      first = last;
+    }
+
+    streaming_memory::release (data);
+  }
+}
+
+bool
+SK_TextureScheduler::gatherFolder (tsf_tex_load_s* job, SK_TextureArchive* pArc)
+{
+  const uint64_t key = folderKey (job);
+
+  SK_LoadList mates;
+
+  for (auto it : workers_) {
+    if (it->queued_ == 0)
+      continue;
+
+    EnterCriticalSection (&it->cs_queue);
+    {
+      it->drainInbox ();
+
+      for (int cls = 0; cls < PriorityCount; cls++) {
+        SK_LoadList& queue = it->queues_ [cls];
+        SK_LoadList  others;
+
+        while (! queue.empty ()) {
+          tsf_tex_load_s* queued = queue.pop_front ();
+
+          if (folderKey (queued) != key) {
+            others.push_back (queued);
+            continue;
+          }
+
+          queued->worker = nullptr;
+          queued->stage  = tsf_tex_load_s::Running;
+
+          mates.push_back (queued);
+
+          InterlockedDecrement (&it->queued_);
+          InterlockedDecrement (&stats_ [cls].depth);
+          InterlockedIncrement (&stats_ [cls].started);
+        }
+
+        queue = others;
+      }
+    }
+    LeaveCriticalSection (&it->cs_queue);
+  }
+
+  bool service = false;
+
+  while (! mates.empty ()) {
+    tsf_tex_load_s* mate = mates.pop_front ();
+
+    beginJob (mate);
+
+    HRESULT hr =
+      TSFix_LoadCancelled (mate) ? E_ABORT :
+                                   TSFix_LocateTexture (mate);
+
+    // Found in a cache after all
+    if (FAILED (hr) || mate->source != tsf_tex_load_s::FromArchive) {
+      advance (mate, hr, &decode_);
+      continue;
+    }
+
+    service |= pArc->submit (mate);
+  }
 
-    if (! streaming_memory::data_len.count (dwThreadId)) {
-      streaming_memory::data_len [dwThreadId] = 0;
-      streaming_memory::data     [dwThreadId] = nullptr;
-      streaming_memory::data_age [dwThreadId] = 0;
+  return service;
+}
+
+size_t
+SK_TextureScheduler::folderQueued (tsf_tex_load_s* job)
+{
+  const uint64_t key = folderKey (job);
+
+  size_t count = 0;
+
+  for (auto it : workers_) {
+    if (it->queued_ == 0)
+      continue;
+
+    EnterCriticalSection (&it->cs_queue);
+    {
+      it->drainInbox ();
+
+      for (int cls = 0; cls < PriorityCount; cls++) {
+        for ( tsf_tex_load_s* queued  = it->queues_ [cls].front ();
+                              queued != nullptr;
+                              queued  = queued->next ) {
+          if (folderKey (queued) == key)
+            ++count;
+        }
+      }
     }
+    LeaveCriticalSection (&it->cs_queue);
   }
-  LeaveCriticalSection (&cs_worker_init);
 
+  return count;
+}
+
+// Large streamed textures are decoded in background mode
+bool
+TSFix_IsBackgroundLoad (tsf_tex_load_s* load)
+{
+  return load->record != nullptr                &&
+         load->record->method == Streaming      &&
+         load->record->size    > (32 * 1024);
+}
+
+// If a system has more than 4 CPUs (logical or otherwise), let the last one
+//   be dedicated to rendering; unless the game is on a loading screen, then
+//     every CPU is fair game.
+void
+TSFix_PinWorkerThread (ULONG thread_num, bool loading)
+{
   SYSTEM_INFO sysinfo;
   GetSystemInfo (&sysinfo);
 
-  ULONG thread_num    = InterlockedIncrement (&num_threads_init);
+  if (loading) {
+    DWORD_PTR dwProcessMask, dwSystemMask;
+
+    if (GetProcessAffinityMask (GetCurrentProcess (), &dwProcessMask, &dwSystemMask)) {
+      SetThreadAffinityMask (GetCurrentThread (), dwProcessMask);
+
+      return;
+    }
+  }
 
-  // If a system has more than 4 CPUs (logical or otherwise), let the last one
-  //   be dedicated to rendering.
   ULONG processor_num = thread_num % ( sysinfo.dwNumberOfProcessors > 4 ?
                                          sysinfo.dwNumberOfProcessors - 1 :
                                          sysinfo.dwNumberOfProcessors );
@@ -3363,156 +9499,241 @@ SK_TextureWorkerThread::ThreadProc (LPVOID user)
 
   SetThreadIdealProcessor (GetCurrentThread (),      processor_num);
   SetThreadAffinityMask   (GetCurrentThread (), 1 << processor_num);
+}
+
+unsigned int
+__stdcall
+SK_TexturePipelineStage::ThreadProc (LPVOID user)
+{
+  static volatile LONG num_threads_init = 0L;
+
+  const ULONG thread_num =
+    InterlockedIncrement (&num_threads_init);
+
+  bool loading = false;
+
+  TSFix_PinWorkerThread (thread_num, loading);
+
+  SK_TexturePipelineStage* pStage =
+    (SK_TexturePipelineStage *)user;
+
+  HANDLE waits [2] = { pStage->items_,
+                       pStage->shutdown_ };
+
+  while (WaitForMultipleObjects (2, waits, FALSE, INFINITE) == WAIT_OBJECT_0) {
+    tsf_tex_load_s* load =
+      pStage->take ();
+
+    if (load == nullptr)
+      continue;
+
+    if (loading != load_phase.loading ()) {
+      loading = (! loading);
+
+      TSFix_PinWorkerThread (thread_num, loading);
+    }
+
+    const bool background =
+      pStage->background_ && TSFix_IsBackgroundLoad (load) && (! loading);
+
+    if (background) {
+      SetThreadPriority ( GetCurrentThread (),
+                            THREAD_PRIORITY_LOWEST |
+                            THREAD_MODE_BACKGROUND_BEGIN );
+    }
+
+    LARGE_INTEGER start, end;
+    QueryPerformanceCounter_Original (&start);
+
+    start_load ();
+
+    // One that carries others along has to do its work regardless
+    HRESULT hr =
+      TSFix_LoadCancelled (load) && load->folder_next == nullptr ? E_ABORT :
+                                                                  pStage->step_ (load);
+
+    end_load ();
+
+    QueryPerformanceCounter_Original (&end);
+
+    if (background) {
+      SetThreadPriority ( GetCurrentThread (),
+                            THREAD_MODE_BACKGROUND_END );
+    }
+
+    pStage->stats.record (end.QuadPart - start.QuadPart, load->SrcDataSize);
+
+    // Fanned out after it, in the order they are stored
+    tsf_tex_load_s* mates = load->folder_next;
+    load->folder_next     = nullptr;
+
+    pStage->sched_->advance (load, hr, pStage->next_);
+
+    while (mates != nullptr) {
+      tsf_tex_load_s* mate = mates;
+      mates                = mates->folder_next;
+
+      mate->folder_next = nullptr;
+
+      pStage->sched_->advance (mate, mate->status, pStage->next_);
+    }
+  }
+
+  _endthreadex (0);
+
+  return 0;
+}
+
+ULONG                   SK_TextureWorkerThread::num_threads_init = 0UL;
+ULONG                   SK_TextureWorkerThread::num_threads      = 0UL;
+
+//
+// The I/O stage: takes jobs in scheduling order, reads their data and hands
+//   them to the decode stage.
+//
+unsigned int
+__stdcall
+SK_TextureWorkerThread::ThreadProc (LPVOID user)
+{
+  ULONG thread_num    = InterlockedIncrement (&num_threads_init);
+  bool  loading       = false;
+
+  TSFix_PinWorkerThread (thread_num, loading);
 
   // Ghetto sync. barrier, since Windows 7 does not support them...
   while ( InterlockedCompareExchange (
             &num_threads_init,
-              config.textures.max_decomp_jobs * 2,
-                config.textures.max_decomp_jobs * 2
-          ) <     config.textures.max_decomp_jobs * 2 ) {
+              num_threads,
+                num_threads
+          ) <     num_threads ) {
     SwitchToThread ();
   }
 
   SK_TextureWorkerThread* pThread =
    (SK_TextureWorkerThread *)user;
 
+  SK_TextureScheduler* pSched =
+    pThread->sched_;
+
   DWORD dwWaitStatus = 0;
 
+  HANDLE waits [2] = { pSched->work_available_,
+                       pSched->shutdown_ };
+
   struct {
     const DWORD job_start  = WAIT_OBJECT_0;
-    const DWORD mem_trim   = WAIT_OBJECT_0 + 1;
-    const DWORD thread_end = WAIT_OBJECT_0 + 2;
+    const DWORD thread_end = WAIT_OBJECT_0 + 1;
+    const DWORD mem_trim   = WAIT_TIMEOUT;
   } wait;
 
+  const DWORD MAX_TIME_BETWEEN_TRIMS = 1500UL;
+  const DWORD FOLDER_WINDOW_MS       =    4UL;
+  const DWORD FOLDER_WINDOW_LOAD_MS  =   16UL; // On a loading screen
+  const DWORD FOLDER_SLICE_MS        =    1UL; // Closes early after one with no new requests
+
   do {
     dwWaitStatus =
-      WaitForMultipleObjects ( 3,
-                                 pThread->control_.ops,
+      WaitForMultipleObjects ( 2,
+                                 waits,
                                    FALSE,
-                                     INFINITE );
+                                     MAX_TIME_BETWEEN_TRIMS );
 
     // New Work Ready
     if (dwWaitStatus == wait.job_start) {
-      tsf_tex_load_s* pStream = pThread->job_;
-
-      start_load ();
-      {
-        InterlockedIncrement   (&streaming);
-        InterlockedExchangeAdd (&streaming_bytes, pStream->SrcDataSize);
+      tsf_tex_load_s* pStream =
+        pSched->takeJob ();
 
-        QueryPerformanceFrequency        (&pStream->freq);
-        QueryPerformanceCounter_Original (&pStream->start);
+      // Claimed by a blocking bind since the semaphore was released
+      if (pStream == nullptr)
+        continue;
 
-        HRESULT hr =
-          InjectTexture (pStream);
+      if (loading != load_phase.loading ()) {
+        loading = (! loading);
 
-        QueryPerformanceCounter_Original (&pStream->end);
-
-        InterlockedExchangeSubtract (&streaming_bytes, pStream->SrcDataSize);
-        InterlockedDecrement        (&streaming);
-
-        if (SUCCEEDED (hr))
-          pThread->pool_->postFinished (pStream);
-
-        pThread->finishJob ();
+        TSFix_PinWorkerThread (thread_num, loading);
       }
-      end_load ();
 
-    }
+      pSched->beginJob (pStream);
 
-    else if (dwWaitStatus == (wait.mem_trim)) {
-      const size_t   MIN_SIZE = 8192 * 1024;
-      const uint32_t MIN_AGE  = 5000UL;
+      LARGE_INTEGER start, end;
+      QueryPerformanceCounter_Original (&start);
 
-      size_t before = streaming_memory::data_len [GetCurrentThreadId ()];
+      HRESULT hr =
+        TSFix_LoadCancelled (pStream) ? E_ABORT :
+                                        TSFix_LocateTexture (pStream);
 
-      streaming_memory::trim (MIN_SIZE, timeGetTime () - MIN_AGE);
+      QueryPerformanceCounter_Original (&end);
 
-      size_t now    =  streaming_memory::data_len [GetCurrentThreadId ()];
-      if (before != now) {
-        tex_log->Log ( L"[ Mem. Mgr ]  Trimmed %9lu bytes of temporary memory for tid=%x",
-                         before - now,
-                           GetCurrentThreadId () );
-      }
-    }
+      // Archived: queued with the archive's other reads, in offset order
+      if (SUCCEEDED (hr) && pStream->source == tsf_tex_load_s::FromArchive) {
+        SK_TextureArchive* pArc =
+          archive_dbs [pStream->record->archive];
 
-    else if (dwWaitStatus != (wait.thread_end)) {
-      dll_log->Log ( L"[ Tex. Mgr ] Unexpected Worker Thread Wait Status: %X",
-                      dwWaitStatus );
-    }
-  } while (dwWaitStatus != (wait.thread_end));
+        bool service = false;
 
-  streaming_memory::trim (0, timeGetTime ());
+        // Areas request dozens of textures from one solid folder within a
+        //   few milliseconds; give the rest a moment, then take them along.
+        //     The moment ends as soon as they stop coming.
+        if (pArc->folderFiles (pArc->folderOf (pStream->record->fileno)) > 1) {
+          if (pStream->priority >= PriorityStreaming) {
+            const DWORD window =
+              loading ? FOLDER_WINDOW_LOAD_MS : FOLDER_WINDOW_MS;
 
-  _endthreadex (0);
+            size_t queued = pSched->folderQueued (pStream);
 
-  return 0;
-}
+            for (DWORD waited = 0UL; waited < window; waited += FOLDER_SLICE_MS) {
+              Sleep (FOLDER_SLICE_MS);
 
-unsigned int
-__stdcall
-SK_TextureThreadPool::Spooler (LPVOID user)
-{
-  SK_TextureThreadPool* pPool =
-    (SK_TextureThreadPool *)user;
+              size_t now = pSched->folderQueued (pStream);
 
-  WaitForSingleObject (pPool->events_.jobs_added, INFINITE);
+              if (now == queued)
+                break;
 
-  while (WaitForSingleObject (pPool->events_.shutdown, 0) == WAIT_TIMEOUT) {
-    tsf_tex_load_s* pJob =
-      pPool->getNextJob ();
+              queued = now;
+            }
+          }
 
-    while (pJob != nullptr) {
-      auto it = pPool->workers_.begin ();
+          service = pSched->gatherFolder (pStream, pArc);
+        }
 
-      bool started = false;
+        service |= pArc->submit (pStream);
 
-      while (it != pPool->workers_.end ()) {
-        if (! (*it)->isBusy ()) {
-          if (! started) {
-            (*it)->startJob (pJob);
-            started = true;
-          } else {
-            (*it)->trim ();
-          }
-        }
+        if (service)
+          pSched->readArchived (pArc);
+        else
+          pArc->waitForRoom ();
 
-        ++it;
+        continue;
       }
 
-      // All worker threads are busy, so wait...
-      if (! started) {
-        WaitForSingleObject (pPool->events_.results_waiting, INFINITE);
-      } else {
-        pJob =
-          pPool->getNextJob ();
-      }
+      pSched->io_stats_.record (end.QuadPart - start.QuadPart, pStream->SrcDataSize);
+
+      pSched->advance (pStream, hr, &pSched->decode_);
     }
 
-    const int MAX_TIME_BETWEEN_TRIMS = 1500UL;
-    while ( WaitForSingleObject (
-              pPool->events_.jobs_added,
-                MAX_TIME_BETWEEN_TRIMS ) ==
-                               WAIT_TIMEOUT ) {
-      auto it = pPool->workers_.begin ();
+    // Idle for a while
+    else if (dwWaitStatus == wait.mem_trim) {
+      const size_t   MIN_SIZE = 8192 * 1024;
+      const uint32_t MIN_AGE  = 5000UL;
 
-      while (it != pPool->workers_.end ()) {
-        if (! (*it)->isBusy ()) {
-          (*it)->trim ();
-        }
+      size_t trimmed =
+        streaming_memory::trim (MIN_SIZE, timeGetTime () - MIN_AGE);
 
-        ++it;
+      if (trimmed > 0) {
+        tex_log->Log ( L"[ Mem. Mgr ]  Trimmed %9lu bytes of temporary memory",
+                         trimmed );
       }
     }
-  }
+
+    else if (dwWaitStatus != (wait.thread_end)) {
+      dll_log->Log ( L"[ Tex. Mgr ] Unexpected Worker Thread Wait Status: %X",
+                      dwWaitStatus );
+    }
+  } while (dwWaitStatus != (wait.thread_end));
+
+  streaming_memory::trim (0, timeGetTime ());
 
   _endthreadex (0);
 
   return 0;
 }
-
-void
-SK_TextureWorkerThread::finishJob (void)
-{
-  job_ = nullptr;
-}
\ No newline at end of file
@@ -26,11 +26,13 @@
 
 #include <set>
 #include <map>
+#include <vector>
 
 #include "../log.h"
 extern iSK_Logger* tex_log;
 
 interface ISKTextureD3D9;
+struct    tsf_tex_policy_s;
 
 namespace tsf {
 namespace RenderFix {
@@ -47,6 +49,7 @@ namespace RenderFix {
   public:
     Texture (void) {
       crc32     = 0;
+      handle    = 0;
       size      = 0;
       refs      = 0;
       load_time = 0.0f;
@@ -54,12 +57,42 @@ namespace RenderFix {
     }
 
     uint32_t        crc32;
+    uint32_t        handle; // Slot in the TextureManager's record slab
     size_t          size;
-    int             refs;
+    LONG            refs;
     float           load_time;
     ISKTextureD3D9* d3d9_tex;
   };
 
+  //
+  // Every texture is charged to one of these, so that a burst of large world
+  //   textures cannot evict the small ones that are visible all the time.
+  //
+  enum tex_partition_t {
+    PartitionUI       = 0,
+    PartitionFont     = 1,
+    PartitionBlocking = 2,
+    PartitionWorld    = 3,
+
+    PartitionCount
+  };
+
+  enum tex_evict_policy_t {
+    EvictNever = 0, // Never purged
+    EvictLast  = 1, // Purged only after every LRU partition
+    EvictLRU   = 2  // Least recently used first
+  };
+
+  struct tex_partition_s {
+    const char*        name     = "";
+    tex_evict_policy_t policy   = EvictLRU;
+    int64_t            min_size = 0LL; // Never purged below this
+    int64_t            max_size = 0LL; // Purged down to this, even under budget (0 = no limit)
+
+    LONG64             size     = 0LL;
+    LONG               count    = 0L;
+  };
+
   class TextureManager {
   public:
     void Init     (void);
@@ -67,15 +100,34 @@ namespace RenderFix {
 
     void                     removeTexture   (ISKTextureD3D9* pTexD3D9);
 
+    // Render thread only, the record may be freed at the next flushRemoves
     tsf::RenderFix::Texture* getTexture (uint32_t crc32);
     void                     addTexture (uint32_t crc32, tsf::RenderFix::Texture* pTex, size_t size);
 
+    // Records come from a slab owned by the manager, never the heap
+    tsf::RenderFix::Texture* allocTexture (void);
+
+    // Lock-free lookup that also adds a reference, nullptr on a miss
+    tsf::RenderFix::Texture* acquireTexture (uint32_t crc32);
+
     // Record a cached reference
     void                     refTexture (tsf::RenderFix::Texture* pTex);
 
+    void                     recordHitTime (LONG64 ns) {
+      InterlockedAdd64 (&hit_ns, ns);
+    }
+
+    // Frees textures whose last reference was released
+    void                     flushRemoves (void);
+
     void                     reset (void);
     void                     purge (void); // WIP
 
+    // Incremental purge, so that eviction can be spread across frames
+    void                     beginPurge (void);
+    bool                     purgeSlice (int budget_us);
+    bool                     purging    (void) { return purge_job.active; }
+
     int                      numTextures (void) {
       return textures.size ();
     }
@@ -87,24 +139,72 @@ namespace RenderFix {
 
     int                      numMSAASurfs (void);
 
-    void                     addInjected (size_t size) {
-      InterlockedIncrement (&injected_count);
-      InterlockedAdd64     (&injected_size, size);
-    }
+    void                     addInjected    (ISKTextureD3D9* pSKTex);
+    void                     removeInjected (ISKTextureD3D9* pSKTex);
+    void                     chargeInjected (ISKTextureD3D9* pSKTex, int64_t size);
+    void                     noteDowngrade  (int64_t saved);
+
+    tex_partition_t          classifyTexture (uint32_t crc32, const tsf_tex_policy_s* policy);
+    bool                     overQuota       (void);
+
+    std::string              osdStats  (void);
+    void                     updateOSD (void); // Marks the stats dirty
 
-    std::string              osdStats  (void) { return osd_stats; }
-    void                     updateOSD (void);
+    // Samples available texture memory and free address space, then moves
+    //   the effective cache limit between MinCacheInMiB and MaxCacheInMiB.
+    void                     updateBudget (void);
+    int                      cacheBudget  (void) { return cache_budget; }
 
   private:
+    void                     rebuildOSD  (void);
+    void                     freeTexture (tsf::RenderFix::Texture* pTex);
+
     std::unordered_map <uint32_t, tsf::RenderFix::Texture*> textures;
-    float                                                   time_saved     = 0.0f;
+    LONG64                                                  time_saved_us  = 0LL;
     ULONG                                                   hits           = 0UL;
+    LONG64                                                  hit_ns         = 0LL;
 
     LONG64                                                  basic_size     = 0LL;
     LONG64                                                  injected_size  = 0LL;
     ULONG                                                   injected_count = 0UL;
 
     std::string                                             osd_stats      = "";
+    LONG                                                    osd_dirty      = 1L;
+
+    int                                                     cache_budget   = 0;   // MiB
+    ULONG                                                   free_vram      = 0UL; // MiB
+    ULONG                                                   free_va        = 0UL; // MiB
+    ULONG                                                   largest_va     = 0UL; // MiB
+    bool                                                    memory_low     = false; // Under MinFreeVRAM / MinFreeVA
+
+    tex_partition_s                                         partitions [PartitionCount];
+
+    // Texture records, in chunks that never move (the lock-free index points
+    //   into them); freed records are reused by handle.
+    static const ULONG                                      record_chunk_size = 256UL;
+    std::vector <tsf::RenderFix::Texture *>                 record_chunks;
+    std::vector <uint32_t>                                  free_records;
+    ULONG                                                   records_used   = 0UL;
+
+    struct {
+      std::vector <uint32_t> candidates;    // Checksums, least recently used first
+      size_t                 next               = 0;
+      bool                   active             = false;
+      bool                   release_only       = false; // Memory is low, downgrades would raise the peak
+
+      int64_t                start_size         = 0LL;
+      int64_t                target_size        = 0LL;
+
+      ULONG                  slices             = 0UL;
+      int                    released           = 0;
+      int                    released_injected  = 0;
+      int                    downgraded         = 0;   // Lose top mip levels instead, counted once swapped
+      uint64_t               reclaimed          = 0ULL;
+      uint64_t               reclaimed_injected = 0ULL;
+
+      size_t                 over_quota         = 0;   // Leading candidates from partitions above their max
+      int64_t                part_reclaimed [PartitionCount];
+    } purge_job;
 
     CRITICAL_SECTION                                        cs_cache;
   } extern tex_mgr;
@@ -234,6 +334,7 @@ public:
      ISKTextureD3D9 (IDirect3DTexture9 **ppTex, SIZE_T size, uint32_t crc32) {
          pTexOverride  = nullptr;
          can_free      = true;
+         cached        = false;
          override_size = 0;
          last_used.QuadPart
                        = 0ULL;
@@ -242,6 +343,12 @@ public:
          tex_size      = size;
          tex_crc32     = crc32;
          must_block    = false;
+         partition     = tsf::RenderFix::PartitionWorld;
+         override_lod  = 0;
+         override_hash = 0ULL;
+         restore_pending
+                       = false;
+         next_waiter   = nullptr;
          refs          =  1;
      };
 
@@ -273,6 +380,25 @@ public:
 
       return ret;
     }
+    // AddRef (...) that refuses to resurrect a texture whose last reference
+    //   is already gone; lock-free cache hits can race a purge.
+    bool AddRefIfAlive (void) {
+      LONG count = (LONG)refs;
+
+      while (count != 0) {
+        LONG prev =
+          InterlockedCompareExchange ((volatile LONG *)&refs, count + 1, count);
+
+        if (prev == count) {
+          can_free = false;
+          return true;
+        }
+
+        count = prev;
+      }
+
+      return false;
+    }
     STDMETHOD_(ULONG,Release)(THIS) {
       ULONG ret = InterlockedDecrement (&refs);
 
@@ -403,15 +529,24 @@ public:
     }
 
     bool               can_free;      // Whether or not we can free this texture
+    bool               cached;        // The texture cache holds a reference to it too
     bool               must_block;    // Whether or not to draw using this texture before its
                                       //  override finishes streaming
 
     IDirect3DTexture9* pTex;          // The original texture data
-    SSIZE_T            tex_size;      //   Original data size
+    SSIZE_T            tex_size;      //   Original data size (VRAM footprint)
     uint32_t           tex_crc32;     //   Original data checksum
 
+    tsf::RenderFix::tex_partition_t
+                       partition;     // Quota and eviction policy this is charged to
+
     IDirect3DTexture9* pTexOverride;  // The overridden texture data (nullptr if unchanged)
-    SSIZE_T            override_size; //   Override data size
+    SSIZE_T            override_size; //   Override data size (VRAM footprint)
+    UINT               override_lod;  //   Top mip levels left out (memory pressure)
+    uint64_t           override_hash; //   Shared with identical overrides (0 = not shared)
+    bool               restore_pending; // Full resolution was requested since it was installed
+
+    ISKTextureD3D9*    next_waiter;   // Waiting on the same in-flight load as this one
 
     ULONG              refs;
     LARGE_INTEGER      last_used;     // The last time this texture was used (for rendering)
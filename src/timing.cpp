@@ -411,6 +411,10 @@ NamcoLoadPAC_Detour (const char* szName)
 
   if (szName != nullptr) {
     dll_log->Log (L"[Namco Func] LoadPAC (%hs)", szName);
+
+    // Texture streaming switches to throughput mode on loading screens
+    extern void TSFix_NoteLoadPAC (const char* szName);
+    TSFix_NoteLoadPAC (szName);
   }
 
   NAMCO_POP
@@ -652,15 +656,20 @@ tsf::TimingFix::Init (void)
     TSFix_EnableHook ((LPVOID)0x5CAE30);
 #endif
 
-#if 0
-#if 0
-    TSFix_CreateFuncHook ( L"NamcoLoadPAC",
-                           (LPVOID)0x579270,
-                           NamcoLoadPAC_Detour,
-                (LPVOID *)&NamcoLoadPAC_Original );
-    TSFix_EnableHook     ((LPVOID)0x579270);
+    //
+    // Like the rest of these, a fixed address in one build of the game; it was
+    //   only ever used to experiment with model swaps (below). Texture streaming
+    //     uses it to detect loading screens and areas, so only hook it for that.
+    //
+    if (config.textures.cache && config.textures.load_screens) {
+      TSFix_CreateFuncHook ( L"NamcoLoadPAC",
+                             (LPVOID)0x579270,
+                             NamcoLoadPAC_Detour,
+                  (LPVOID *)&NamcoLoadPAC_Original );
+      TSFix_EnableHook     ((LPVOID)0x579270);
+    }
 
-#else
+#if 0
     TSFix_CreateFuncHook ( L"NamcoLoad",
                            (LPVOID)0x00579295,
                            NamcoLoad_,
@@ -676,7 +685,6 @@ tsf::TimingFix::Init (void)
     remaps ["BTLREFILL0.PAC"] = "BTLCOLLET3.PAC";
     //remaps ["BTLLLOYD0.PAC"] = "BTLLLOYD9.PAC";
 #endif
-#endif
 
 // TOS.exe+C3131 - C6 45 FC 02           - mov byte ptr [ebp-04],02 { 00000002 }
 